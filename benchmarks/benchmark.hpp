@@ -0,0 +1,71 @@
+#ifndef BENCHMARK_HPP
+#define BENCHMARK_HPP
+
+#include <algorithm>
+#include <chrono>
+#include <cstdint>
+#include <vector>
+
+template< typename F >
+double measure( F && f )
+{
+    auto start = std::chrono::steady_clock::now();
+    f();
+    auto finish = std::chrono::steady_clock::now();
+    return std::chrono::duration<double>( finish - start ).count();
+}
+
+/**
+ * @brief Collects per-operation latencies in nanoseconds.
+ */
+class latency_t
+{
+public:
+    explicit latency_t( std::size_t capacity = 0 )
+    {
+        samples_.reserve( capacity );
+    }
+    
+    template< typename F >
+    void record( F && f )
+    {
+        auto start = std::chrono::steady_clock::now();
+        f();
+        auto finish = std::chrono::steady_clock::now();
+        samples_.push_back( std::chrono::duration_cast<std::chrono::nanoseconds>( finish - start ).count() );
+    }
+    
+    auto count() const -> std::size_t
+    {
+        return samples_.size();
+    }
+    
+    auto total() const -> double
+    {
+        double sum = 0;
+        for( auto sample : samples_ ) {
+            sum += sample;
+        }
+        
+        return sum * 1e-9;
+    }
+    
+    /**
+     * @param fraction Value in [0, 1], e.g. 0.99 for p99.
+     */
+    auto percentile( double fraction ) -> std::uint64_t
+    {
+        if( samples_.empty() ) {
+            return 0;
+        }
+        
+        auto n = static_cast<std::size_t>( fraction * ( samples_.size() - 1 ) );
+        std::nth_element( samples_.begin(), samples_.begin() + n, samples_.end() );
+        return samples_[ n ];
+    }
+    
+private:
+    std::vector<std::uint64_t> samples_;
+};
+
+#endif
@@ -0,0 +1,92 @@
+#include <cstdint>
+#include <cstdlib>
+#include <iostream>
+#include <iterator>
+#include <random>
+#include <vector>
+
+#include "benchmark.hpp"
+#include "rb_tree.hpp"
+
+// Scatters nodes over the heap with insert/remove churn and measures
+// in-order scans and lookups before and after compact().
+
+template< typename T >
+void run( rb_tree_t<T> const & tree, std::vector<T> const & keys, char const * title )
+{
+    std::uint64_t sum = 0;
+    auto scan_time = measure( [&] {
+        tree.for_each( [&]( T key ) { sum += key; } );
+    } );
+    
+    std::size_t found = 0;
+    auto lookup_time = measure( [&] {
+        for( auto it = keys.begin(); it != keys.end(); ++it ) {
+            bool result;
+            tree.find_many( it, std::next( it ), &result );
+            found += result;
+        }
+    } );
+    
+    std::cout << title << "\tscan " << tree.size() / scan_time / 1e6 << " Mkeys/s"
+              << "\tlookup " << keys.size() / lookup_time / 1e6 << " Mops/s"
+              << "\t(" << sum % 10 + found % 10 << ")" << std::endl;
+}
+
+int main( int argc, const char * argv[] )
+{
+    std::size_t size = argc > 1 ? std::strtoull( argv[ 1 ], nullptr, 10 ) : std::size_t{ 1 } << 20;
+    
+    std::mt19937_64 random{ 42 };
+    rb_tree_t<std::uint64_t> tree;
+    std::vector<std::uint64_t> live;
+    for( std::size_t i = 0; i < size; ++i ) {
+        live.push_back( random() );
+        tree.insert( live.back() );
+    }
+    
+    for( std::size_t i = 0; i < size * 4; ++i ) {
+        auto & victim = live[ random() % live.size() ];
+        tree.remove( victim );
+        victim = random();
+        tree.insert( victim );
+    }
+    
+    std::vector<std::uint64_t> keys;
+    for( std::size_t i = 0; i < ( std::size_t{ 1 } << 20 ); ++i ) {
+        keys.push_back( live[ random() % live.size() ] );
+    }
+    
+    run( tree, keys, "churned" );
+    
+    auto compact_time = measure( [&] { tree.compact(); } );
+    std::cout << "compact\t" << compact_time * 1e3 << " ms" << std::endl;
+    
+    run( tree, keys, "compacted" );
+    
+    // Incremental compaction interleaved with the same churn, it must finish despite the mutations
+    for( std::size_t i = 0; i < size; ++i ) {
+        auto & victim = live[ random() % live.size() ];
+        tree.remove( victim );
+        victim = random();
+        tree.insert( victim );
+    }
+    
+    std::size_t const budget = 64;
+    std::size_t calls = 0;
+    auto churn_time = measure( [&] {
+        do {
+            auto & victim = live[ random() % live.size() ];
+            tree.remove( victim );
+            victim = random();
+            tree.insert( victim );
+            ++calls;
+        } while( !tree.compact( budget ) );
+    } );
+    std::cout << "compact under churn\t" << calls << " calls of " << budget << " nodes, "
+              << churn_time * 1e3 << " ms" << std::endl;
+    
+    run( tree, keys, "churned compacted" );
+    
+    return 0;
+}
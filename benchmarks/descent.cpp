@@ -0,0 +1,144 @@
+#include <chrono>
+#include <cstdint>
+#include <cstdlib>
+#include <cstring>
+#include <iostream>
+#include <random>
+#include <vector>
+
+#if defined(__linux__)
+#include <linux/perf_event.h>
+#include <sys/ioctl.h>
+#include <sys/syscall.h>
+#include <unistd.h>
+#endif
+
+#include "rb_tree.hpp"
+
+// Compares the branch-light descent used for arithmetic keys against the generic
+// three-way descent. Branch misses are read from perf counters when the kernel allows it.
+
+struct generic_less
+{
+    bool operator ()( std::uint64_t lhs, std::uint64_t rhs ) const
+    {
+        return lhs < rhs;
+    }
+};
+
+class counter_t
+{
+public:
+    explicit counter_t( std::uint64_t config )
+    {
+#if defined(__linux__)
+        perf_event_attr attr;
+        std::memset( &attr, 0, sizeof( attr ) );
+        attr.type = PERF_TYPE_HARDWARE;
+        attr.size = sizeof( attr );
+        attr.config = config;
+        attr.disabled = 1;
+        attr.exclude_kernel = 1;
+        attr.exclude_hv = 1;
+        fd_ = static_cast<int>( syscall( __NR_perf_event_open, &attr, 0, -1, -1, 0 ) );
+#else
+        (void)config;
+#endif
+    }
+    
+    ~counter_t()
+    {
+#if defined(__linux__)
+        if( fd_ >= 0 ) {
+            close( fd_ );
+        }
+#endif
+    }
+    
+    void start()
+    {
+#if defined(__linux__)
+        if( fd_ >= 0 ) {
+            ioctl( fd_, PERF_EVENT_IOC_RESET, 0 );
+            ioctl( fd_, PERF_EVENT_IOC_ENABLE, 0 );
+        }
+#endif
+    }
+    
+    // Returns -1 if the counter is not available
+    long long stop()
+    {
+        long long value = -1;
+#if defined(__linux__)
+        if( fd_ >= 0 ) {
+            ioctl( fd_, PERF_EVENT_IOC_DISABLE, 0 );
+            if( read( fd_, &value, sizeof( value ) ) != sizeof( value ) ) {
+                value = -1;
+            }
+        }
+#endif
+        return value;
+    }
+    
+private:
+    int fd_ = -1;
+};
+
+template< typename Tree >
+void run( Tree const & tree, std::vector<std::uint64_t> const & keys, char const * title )
+{
+#if defined(__linux__)
+    counter_t misses{ PERF_COUNT_HW_BRANCH_MISSES };
+    counter_t branches{ PERF_COUNT_HW_BRANCH_INSTRUCTIONS };
+#else
+    counter_t misses{ 0 };
+    counter_t branches{ 0 };
+#endif
+    
+    std::size_t found = 0;
+    misses.start();
+    branches.start();
+    auto start = std::chrono::steady_clock::now();
+    for( auto key : keys ) {
+        found += tree.contains( key );
+    }
+    auto finish = std::chrono::steady_clock::now();
+    auto branch_count = branches.stop();
+    auto miss_count = misses.stop();
+    
+    auto seconds = std::chrono::duration<double>( finish - start ).count();
+    std::cout << title << '\t' << keys.size() / seconds / 1e6 << " Mops/s\t";
+    if( miss_count >= 0 && branch_count >= 0 ) {
+        std::cout << double( miss_count ) / keys.size() << " misses/op\t"
+                  << double( branch_count ) / keys.size() << " branches/op";
+    }
+    else {
+        std::cout << "perf counters unavailable";
+    }
+    std::cout << "\t(" << found << " found)" << std::endl;
+}
+
+int main( int argc, const char * argv[] )
+{
+    std::size_t size = argc > 1 ? std::strtoull( argv[ 1 ], nullptr, 10 ) : std::size_t{ 1 } << 16;
+    std::size_t const lookups = std::size_t{ 1 } << 22;
+    
+    std::mt19937_64 random{ 42 };
+    rb_tree_t<std::uint64_t> branchless;
+    rb_tree_t<std::uint64_t, generic_less> generic;
+    for( std::size_t i = 0; i < size; ++i ) {
+        auto key = random() % ( size * 2 );
+        branchless.insert( key );
+        generic.insert( key );
+    }
+    
+    std::vector<std::uint64_t> keys( lookups );
+    for( auto && key : keys ) {
+        key = random() % ( size * 2 );
+    }
+    
+    run( generic, keys, "generic" );
+    run( branchless, keys, "branchless" );
+    
+    return 0;
+}
@@ -0,0 +1,56 @@
+#include <cstdint>
+#include <cstdlib>
+#include <iostream>
+#include <iterator>
+#include <random>
+#include <vector>
+
+#include "benchmark.hpp"
+#include "rb_tree.hpp"
+
+// Compares one-at-a-time contains() against interleaved find_many.
+// Tree sizes go from a few L2-resident nodes up to far beyond the last level cache.
+
+int main( int argc, const char * argv[] )
+{
+    std::size_t max_size = argc > 1 ? std::strtoull( argv[ 1 ], nullptr, 10 ) : std::size_t{ 1 } << 22;
+    std::size_t const lookups = std::size_t{ 1 } << 20;
+    
+    std::mt19937_64 random{ 42 };
+    std::cout << "size\tsingle Mops/s\tfind_many Mops/s\n";
+    
+    for( std::size_t size = std::size_t{ 1 } << 10; size <= max_size; size <<= 2 ) {
+        rb_tree_t<std::uint64_t> tree;
+        for( std::size_t i = 0; i < size; ++i ) {
+            tree.insert( random() % ( size * 2 ) );
+        }
+        
+        std::vector<std::uint64_t> keys( lookups );
+        for( auto && key : keys ) {
+            key = random() % ( size * 2 );
+        }
+        
+        std::vector<bool> single;
+        single.reserve( lookups );
+        auto single_time = measure( [&] {
+            for( auto key : keys ) {
+                single.push_back( tree.contains( key ) );
+            }
+        } );
+        
+        std::vector<bool> many;
+        many.reserve( lookups );
+        auto many_time = measure( [&] {
+            tree.find_many( keys.begin(), keys.end(), std::back_inserter( many ) );
+        } );
+        
+        if( single != many ) {
+            std::cerr << "mismatch at size " << size << std::endl;
+            return 1;
+        }
+        
+        std::cout << size << '\t' << lookups / single_time / 1e6 << '\t' << lookups / many_time / 1e6 << std::endl;
+    }
+    
+    return 0;
+}
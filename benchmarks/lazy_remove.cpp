@@ -0,0 +1,58 @@
+#include <algorithm>
+#include <cstdint>
+#include <cstdlib>
+#include <functional>
+#include <iostream>
+#include <random>
+#include <string>
+#include <vector>
+
+#include "benchmark.hpp"
+#include "rb_tree.hpp"
+
+// Latency of a burst of removes that takes out half of the keys: eager removal against
+// tombstones purged inline with a budget, and against tombstones rebuilt away at once.
+
+int main( int argc, const char * argv[] )
+{
+    std::size_t size = argc > 1 ? std::strtoull( argv[ 1 ], nullptr, 10 ) : std::size_t{ 1 } << 20;
+    
+    std::mt19937_64 random{ 42 };
+    std::vector<std::uint64_t> keys( size );
+    for( auto && key : keys ) {
+        key = random();
+    }
+    std::vector<std::uint64_t> burst( keys.begin(), keys.begin() + size / 2 );
+    std::shuffle( burst.begin(), burst.end(), random );
+    
+    std::vector<std::pair<std::string, std::function<void( rb_tree_t<std::uint64_t> & )>>> modes = {
+        { "eager", []( rb_tree_t<std::uint64_t> & ) {} },
+        { "lazy, budget 32", []( rb_tree_t<std::uint64_t> & tree ) { tree.lazy_remove( 0.25, 32 ); } },
+        { "lazy, rebuild", []( rb_tree_t<std::uint64_t> & tree ) { tree.lazy_remove( 0.25 ); } }
+    };
+    
+    std::cout << "mode\tMops/s\tp50\tp99\tp99.9\tmax\t(ns)\n";
+    for( auto && mode : modes ) {
+        rb_tree_t<std::uint64_t> tree;
+        for( auto key : keys ) {
+            tree.insert( key );
+        }
+        mode.second( tree );
+        
+        latency_t latency{ burst.size() };
+        for( auto key : burst ) {
+            latency.record( [&] {
+                tree.remove( key );
+            } );
+        }
+        
+        std::cout << mode.first
+                  << '\t' << burst.size() / latency.total() * 1e-6
+                  << '\t' << latency.percentile( 0.5 )
+                  << '\t' << latency.percentile( 0.99 )
+                  << '\t' << latency.percentile( 0.999 )
+                  << '\t' << latency.percentile( 1 ) << std::endl;
+    }
+    
+    return 0;
+}
@@ -0,0 +1,72 @@
+#include <algorithm>
+#include <cstdint>
+#include <cstdlib>
+#include <iostream>
+#include <random>
+#include <vector>
+
+#include "benchmark.hpp"
+#include "block_partition.hpp"
+#include "dual_pivot_partition.hpp"
+#include "multiway_partition.hpp"
+
+// Distributes random keys into k buckets by one multiway_partition against log k levels of
+// block_partition, and splits into three parts by dual_pivot_partition against two block_partitions.
+
+template< typename _Iterator, typename T >
+void bisect( _Iterator first, _Iterator last, T const * splitters_first, T const * splitters_last )
+{
+    if( splitters_first == splitters_last ) {
+        return;
+    }
+    
+    auto middle = splitters_first + ( splitters_last - splitters_first ) / 2;
+    auto parts = block_partition( first, last, *middle );
+    bisect( first, parts.equal.begin, splitters_first, middle );
+    bisect( parts.equal.begin, last, middle + 1, splitters_last );
+}
+
+int main( int argc, const char * argv[] )
+{
+    std::size_t size = argc > 1 ? std::strtoull( argv[ 1 ], nullptr, 10 ) : std::size_t{ 1 } << 24;
+    
+    std::mt19937_64 random{ 42 };
+    std::vector<std::uint32_t> source( size );
+    for( auto && value : source ) {
+        value = std::uint32_t( random() );
+    }
+    
+    std::cout << "buckets\tmultiway\tbisection\t(Melements/s)\n";
+    for( std::size_t buckets = 4; buckets <= 1024; buckets *= 4 ) {
+        std::vector<std::uint32_t> splitters( buckets - 1 );
+        for( std::size_t i = 0; i < splitters.size(); ++i ) {
+            splitters[ i ] = std::uint32_t( ( std::uint64_t( 1 ) << 32 ) * ( i + 1 ) / buckets );
+        }
+        
+        auto values = source;
+        auto multiway = measure( [&] {
+            multiway_partition( values.begin(), values.end(), splitters );
+        } );
+        values = source;
+        auto bisection = measure( [&] {
+            bisect( values.begin(), values.end(), splitters.data(), splitters.data() + splitters.size() );
+        } );
+        
+        std::cout << buckets << '\t' << size / multiway / 1e6 << '\t' << size / bisection / 1e6 << std::endl;
+    }
+    
+    auto pivot1 = std::uint32_t( 1 ) << 30;
+    auto pivot2 = std::uint32_t( 3 ) << 30;
+    auto values = source;
+    auto dual = measure( [&] {
+        dual_pivot_partition( values.begin(), values.end(), pivot1, pivot2 );
+    } );
+    values = source;
+    auto twice = measure( [&] {
+        auto parts = block_partition( values.begin(), values.end(), pivot1 );
+        block_partition( parts.great.begin, values.end(), pivot2 );
+    } );
+    std::cout << "dual pivot\t" << size / dual / 1e6 << "\ttwo single pivots\t" << size / twice / 1e6 << std::endl;
+    
+    return 0;
+}
@@ -0,0 +1,45 @@
+#include <cstdint>
+#include <cstdlib>
+#include <iostream>
+#include <random>
+#include <thread>
+#include <vector>
+
+#include "benchmark.hpp"
+#include "block_partition.hpp"
+#include "parallel_partition.hpp"
+
+// Scaling of parallel_partition with the number of threads against block_partition on one thread.
+
+int main( int argc, const char * argv[] )
+{
+    std::size_t size = argc > 1 ? std::strtoull( argv[ 1 ], nullptr, 10 ) : std::size_t{ 1 } << 26;
+    std::size_t max_threads = argc > 2 ? std::strtoull( argv[ 2 ], nullptr, 10 ) : std::thread::hardware_concurrency();
+    
+    std::mt19937_64 random{ 42 };
+    std::vector<std::uint32_t> source( size );
+    for( auto && value : source ) {
+        value = std::uint32_t( random() );
+    }
+    auto pivot = std::uint32_t( 1 ) << 31;
+    
+    std::vector<std::uint32_t> values = source;
+    auto serial = measure( [&] {
+        block_partition( values.begin(), values.end(), pivot );
+    } );
+    
+    std::cout << "threads\tseconds\tspeedup\n";
+    std::cout << "serial\t" << serial << "\t1" << std::endl;
+    
+    for( std::size_t threads = 1; threads <= max_threads; threads *= 2 ) {
+        thread_pool_t pool{ threads };
+        values = source;
+        auto parallel = measure( [&] {
+            parallel_partition( values.begin(), values.end(), pivot, pool );
+        } );
+        
+        std::cout << threads << '\t' << parallel << '\t' << serial / parallel << std::endl;
+    }
+    
+    return 0;
+}
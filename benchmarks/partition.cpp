@@ -0,0 +1,72 @@
+#include <cstdint>
+#include <cstdlib>
+#include <iostream>
+#include <random>
+#include <vector>
+
+#include "benchmark.hpp"
+#include "block_partition.hpp"
+#include "hoare_partition.hpp"
+#include "lomuto_partition.hpp"
+#include "simd_partition.hpp"
+
+// Compares the generic three-way partitions against the block and vectorized ones on random keys,
+// pivot is the median of the key range.
+
+template< typename T, typename F >
+double run( std::vector<T> const & source, std::size_t repeats, F partition )
+{
+    std::vector<T> values;
+    double seconds = 0;
+    for( std::size_t i = 0; i < repeats; ++i ) {
+        values = source;
+        seconds += measure( [&] {
+            partition( values );
+        } );
+    }
+
+    return source.size() * repeats / seconds / 1e6;
+}
+
+template< typename T >
+void compare( char const * name, std::size_t max_size, std::mt19937_64 & random )
+{
+    for( std::size_t size = std::size_t{ 1 } << 10; size <= max_size; size <<= 3 ) {
+        std::vector<T> source( size );
+        for( auto && value : source ) {
+            value = T( random() % 1000000 );
+        }
+        auto pivot = T( 500000 );
+        auto repeats = max_size / size;
+
+        auto hoare = run( source, repeats, [&]( std::vector<T> & values ) {
+            hoare_partition( values.data(), values.data() + values.size(), pivot );
+        } );
+        auto lomuto = run( source, repeats, [&]( std::vector<T> & values ) {
+            lomuto_partition( values.data(), values.data() + values.size(), pivot );
+        } );
+        auto block = run( source, repeats, [&]( std::vector<T> & values ) {
+            block_partition( values.data(), values.data() + values.size(), pivot );
+        } );
+        auto simd = run( source, repeats, [&]( std::vector<T> & values ) {
+            simd_partition( values.data(), values.data() + values.size(), pivot );
+        } );
+
+        std::cout << name << '\t' << size << '\t' << hoare << '\t' << lomuto << '\t' << block << '\t' << simd << std::endl;
+    }
+}
+
+int main( int argc, const char * argv[] )
+{
+    std::size_t max_size = argc > 1 ? std::strtoull( argv[ 1 ], nullptr, 10 ) : std::size_t{ 1 } << 22;
+
+    std::mt19937_64 random{ 42 };
+    std::cout << "type\tsize\thoare\tlomuto\tblock\tsimd\t(Melements/s)\n";
+
+    compare<std::int32_t>( "int32", max_size, random );
+    compare<float>( "float", max_size, random );
+    compare<std::int64_t>( "int64", max_size, random );
+    compare<double>( "double", max_size, random );
+
+    return 0;
+}
@@ -0,0 +1,158 @@
+#include <cstdint>
+#include <cstdlib>
+#include <deque>
+#include <functional>
+#include <iostream>
+#include <queue>
+#include <random>
+#include <unordered_map>
+#include <vector>
+
+#include "benchmark.hpp"
+#include "rb_tree.hpp"
+#include "sliding_quantile.hpp"
+
+// Rolling median and p99 of the last window samples. sliding_quantile_t is compared against
+// separate insert, remove and select calls on rb_tree_t, and against the two-heap median.
+
+namespace
+{
+    // Lower median of a sliding window in a max-heap and a min-heap, expired samples are
+    // dropped lazily once they reach the top of their heap.
+    class two_heap_median_t
+    {
+    public:
+        explicit two_heap_median_t( std::size_t window ) : window_{ window }
+        {
+        }
+        
+        void push( std::int64_t sample )
+        {
+            samples_.push_back( sample );
+            if( low_.empty() || sample <= low_.top() ) {
+                low_.push( sample );
+                ++low_size_;
+            }
+            else {
+                high_.push( sample );
+                ++high_size_;
+            }
+            
+            if( samples_.size() > window_ ) {
+                auto expired = samples_.front();
+                samples_.pop_front();
+                ++pending_[ expired ];
+                if( expired <= low_.top() ) {
+                    --low_size_;
+                }
+                else {
+                    --high_size_;
+                }
+            }
+            
+            balance();
+        }
+        
+        auto median() -> std::int64_t
+        {
+            return low_.top();
+        }
+        
+    private:
+        std::size_t window_;
+        std::deque<std::int64_t> samples_;
+        std::priority_queue<std::int64_t> low_;
+        std::priority_queue<std::int64_t, std::vector<std::int64_t>, std::greater<std::int64_t>> high_;
+        // Sizes without expired samples
+        std::size_t low_size_ = 0;
+        std::size_t high_size_ = 0;
+        std::unordered_map<std::int64_t, std::size_t> pending_;
+        
+        template< typename Heap >
+        void prune( Heap & heap )
+        {
+            while( !heap.empty() ) {
+                auto found = pending_.find( heap.top() );
+                if( found == pending_.end() ) {
+                    return;
+                }
+                if( --found->second == 0 ) {
+                    pending_.erase( found );
+                }
+                heap.pop();
+            }
+        }
+        
+        void balance()
+        {
+            prune( low_ );
+            prune( high_ );
+            while( low_size_ > high_size_ + 1 ) {
+                high_.push( low_.top() );
+                low_.pop();
+                --low_size_;
+                ++high_size_;
+                prune( low_ );
+            }
+            while( high_size_ > low_size_ ) {
+                low_.push( high_.top() );
+                high_.pop();
+                ++low_size_;
+                --high_size_;
+                prune( high_ );
+            }
+        }
+    };
+}
+
+int main( int argc, const char * argv[] )
+{
+    std::size_t count = argc > 1 ? std::strtoull( argv[ 1 ], nullptr, 10 ) : std::size_t{ 1 } << 22;
+    
+    std::mt19937_64 random{ 42 };
+    std::vector<std::int64_t> samples( count );
+    for( auto && sample : samples ) {
+        sample = std::int64_t( random() % 1000000 );
+    }
+    
+    std::cout << "window\tsliding_quantile\tinsert+remove+select\ttwo-heap median\t(Msamples/s)\n";
+    
+    for( std::size_t window = 128; window <= 1u << 17; window <<= 3 ) {
+        std::int64_t sink = 0;
+        
+        sliding_quantile_t<std::int64_t> quantiles{ window };
+        auto fused = measure( [&] {
+            for( auto sample : samples ) {
+                quantiles.push( sample );
+                sink += quantiles.quantile( 0.5 ) + quantiles.quantile( 0.99 );
+            }
+        } );
+        
+        rb_tree_t<std::int64_t> tree;
+        auto separate = measure( [&] {
+            for( std::size_t i = 0; i < samples.size(); ++i ) {
+                tree.insert( samples[ i ] );
+                if( i >= window ) {
+                    tree.remove( samples[ i - window ] );
+                }
+                sink += *tree.select( ( tree.size() + 1 ) / 2 ) + *tree.select( ( tree.size() * 99 + 99 ) / 100 );
+            }
+        } );
+        
+        two_heap_median_t heaps{ window };
+        auto two_heap = measure( [&] {
+            for( auto sample : samples ) {
+                heaps.push( sample );
+                sink += heaps.median();
+            }
+        } );
+        
+        std::cout << window
+                  << '\t' << count / fused * 1e-6
+                  << '\t' << count / separate * 1e-6
+                  << '\t' << count / two_heap * 1e-6
+                  << ( sink == 0 ? "\n" : "\n" ) << std::flush;
+    }
+    
+    return 0;
+}
@@ -0,0 +1,73 @@
+#include <algorithm>
+#include <cstdint>
+#include <cstdlib>
+#include <iostream>
+#include <random>
+#include <string>
+#include <vector>
+
+#include "benchmark.hpp"
+#include "intro_sort.hpp"
+
+// Compares intro_sort, quick_select and partial_intro_sort against std::sort, std::nth_element and
+// std::partial_sort on random, sorted, descending and duplicate-heavy keys. Both take vector iterators.
+
+template< typename F >
+double run( std::vector<std::int32_t> const & source, F f )
+{
+    auto values = source;
+    return measure( [&] {
+        f( values );
+    } );
+}
+
+int main( int argc, const char * argv[] )
+{
+    std::size_t size = argc > 1 ? std::strtoull( argv[ 1 ], nullptr, 10 ) : std::size_t{ 1 } << 22;
+    
+    std::mt19937_64 random{ 42 };
+    std::vector<std::pair<std::string, std::vector<std::int32_t>>> inputs = {
+        { "random", std::vector<std::int32_t>( size ) },
+        { "sorted", std::vector<std::int32_t>( size ) },
+        { "descending", std::vector<std::int32_t>( size ) },
+        { "duplicates", std::vector<std::int32_t>( size ) }
+    };
+    for( std::size_t i = 0; i < size; ++i ) {
+        inputs[ 0 ].second[ i ] = std::int32_t( random() );
+        inputs[ 1 ].second[ i ] = std::int32_t( i );
+        inputs[ 2 ].second[ i ] = std::int32_t( size - i );
+        inputs[ 3 ].second[ i ] = std::int32_t( random() % 16 );
+    }
+    
+    std::cout << "input\tstd::sort\tintro_sort\tstd::nth_element\tquick_select\tstd::partial_sort\tpartial_intro_sort\t(ms)\n";
+    
+    auto k = size / 100;
+    for( auto && input : inputs ) {
+        auto && source = input.second;
+        auto std_sort = run( source, []( std::vector<std::int32_t> & values ) {
+            std::sort( values.begin(), values.end() );
+        } );
+        auto sort = run( source, []( std::vector<std::int32_t> & values ) {
+            intro_sort( values.begin(), values.end() );
+        } );
+        auto std_select = run( source, []( std::vector<std::int32_t> & values ) {
+            std::nth_element( values.begin(), values.begin() + values.size() / 2, values.end() );
+        } );
+        auto select = run( source, []( std::vector<std::int32_t> & values ) {
+            quick_select( values.begin(), values.begin() + values.size() / 2, values.end() );
+        } );
+        auto std_partial = run( source, [&]( std::vector<std::int32_t> & values ) {
+            std::partial_sort( values.begin(), values.begin() + k, values.end() );
+        } );
+        auto partial = run( source, [&]( std::vector<std::int32_t> & values ) {
+            partial_intro_sort( values.begin(), values.begin() + k, values.end() );
+        } );
+        
+        std::cout << input.first
+                  << '\t' << std_sort * 1e3 << '\t' << sort * 1e3
+                  << '\t' << std_select * 1e3 << '\t' << select * 1e3
+                  << '\t' << std_partial * 1e3 << '\t' << partial * 1e3 << std::endl;
+    }
+    
+    return 0;
+}
@@ -0,0 +1,507 @@
+#include <algorithm>
+#include <cmath>
+#include <cstddef>
+#include <cstdint>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <fstream>
+#include <iostream>
+#include <new>
+#include <random>
+#include <set>
+#include <string>
+#include <vector>
+
+#include "benchmark.hpp"
+#include "rb_tree.hpp"
+
+// Throughput, latency and memory of rb_tree_t against std::set and std::multiset.
+//
+//   benchmarks [--size N] [--seed S] [--out results.json]
+//
+// Every structure runs the same key sequences: random, sorted, zipf (duplicate-heavy)
+// and churn (remove a live key, insert a fresh one). Results are written as JSON.
+
+namespace
+{
+    // Requested bytes currently allocated through operator new.
+    std::size_t live_bytes = 0;
+
+    std::size_t const header_size = sizeof( std::max_align_t );
+    
+    // Keeps lookup results observable so they are not optimized away.
+    std::size_t volatile sink = 0;
+}
+
+void * operator new( std::size_t size )
+{
+    auto base = static_cast<char *>( std::malloc( size + header_size ) );
+    if( !base ) {
+        throw std::bad_alloc{};
+    }
+
+    std::memcpy( base, &size, sizeof( size ) );
+    live_bytes += size;
+    return base + header_size;
+}
+
+void operator delete( void * pointer ) noexcept
+{
+    if( pointer ) {
+        auto base = static_cast<char *>( pointer ) - header_size;
+        std::size_t size;
+        std::memcpy( &size, base, sizeof( size ) );
+        live_bytes -= size;
+        std::free( base );
+    }
+}
+
+void operator delete( void * pointer, std::size_t ) noexcept
+{
+    operator delete( pointer );
+}
+
+namespace
+{
+    template< typename K >
+    struct rb_tree_adapter
+    {
+        static char const * name()
+        {
+            return "rb_tree_t";
+        }
+
+        void insert( K const & key )
+        {
+            tree.insert( key );
+        }
+
+        void remove( K const & key )
+        {
+            tree.remove( key );
+        }
+
+        bool contains( K const & key ) const
+        {
+            return tree.contains( key );
+        }
+
+        template< typename F >
+        void scan( F f ) const
+        {
+            tree.for_each( f );
+        }
+
+        static bool const has_select = true;
+
+        bool select( std::size_t n ) const
+        {
+            return tree.select( n ) != nullptr;
+        }
+
+        auto size() const -> std::size_t
+        {
+            return tree.size();
+        }
+
+        rb_tree_t<K> tree;
+    };
+
+    template< typename Set >
+    struct std_adapter
+    {
+        using key_type = typename Set::key_type;
+
+        static char const * name();
+
+        void insert( key_type const & key )
+        {
+            set.insert( key );
+        }
+
+        void remove( key_type const & key )
+        {
+            auto it = set.find( key );
+            if( it != set.end() ) {
+                set.erase( it );
+            }
+        }
+
+        bool contains( key_type const & key ) const
+        {
+            return set.find( key ) != set.end();
+        }
+
+        template< typename F >
+        void scan( F f ) const
+        {
+            for( auto && key : set ) {
+                f( key );
+            }
+        }
+
+        // Rank queries are linear on std containers and are not measured.
+        static bool const has_select = false;
+
+        bool select( std::size_t ) const
+        {
+            return false;
+        }
+
+        auto size() const -> std::size_t
+        {
+            return set.size();
+        }
+
+        Set set;
+    };
+
+    template<>
+    char const * std_adapter<std::set<int>>::name()
+    {
+        return "std::set";
+    }
+
+    template<>
+    char const * std_adapter<std::set<std::string>>::name()
+    {
+        return "std::set";
+    }
+
+    template<>
+    char const * std_adapter<std::multiset<int>>::name()
+    {
+        return "std::multiset";
+    }
+
+    template<>
+    char const * std_adapter<std::multiset<std::string>>::name()
+    {
+        return "std::multiset";
+    }
+
+    // Keys are generated as integers and converted for every key type.
+    template< typename K >
+    auto make_key( std::uint64_t value ) -> K;
+
+    template<>
+    auto make_key<int>( std::uint64_t value ) -> int
+    {
+        return static_cast<int>( value & 0x7fffffff );
+    }
+
+    template<>
+    auto make_key<std::string>( std::uint64_t value ) -> std::string
+    {
+        char buffer[ 32 ];
+        std::snprintf( buffer, sizeof( buffer ), "key:%012llu", static_cast<unsigned long long>( value ) );
+        return buffer;
+    }
+
+    template< typename K >
+    char const * key_name();
+
+    template<>
+    char const * key_name<int>()
+    {
+        return "int";
+    }
+
+    template<>
+    char const * key_name<std::string>()
+    {
+        return "string";
+    }
+
+    /**
+     * @brief Draws ranks in [0, n) with probability proportional to 1 / ( rank + 1 )^s.
+     */
+    class zipf_t
+    {
+    public:
+        zipf_t( std::size_t n, double s )
+        {
+            cdf_.reserve( n );
+            double sum = 0;
+            for( std::size_t i = 0; i < n; ++i ) {
+                sum += 1.0 / std::pow( i + 1.0, s );
+                cdf_.push_back( sum );
+            }
+            for( auto && value : cdf_ ) {
+                value /= sum;
+            }
+        }
+
+        template< typename Random >
+        auto operator ()( Random & random ) -> std::size_t
+        {
+            auto u = std::uniform_real_distribution<double>{ 0.0, 1.0 }( random );
+            auto it = std::lower_bound( cdf_.begin(), cdf_.end(), u );
+            return std::min<std::size_t>( it - cdf_.begin(), cdf_.size() - 1 );
+        }
+
+    private:
+        std::vector<double> cdf_;
+    };
+
+    struct workload_t
+    {
+        char const * name;
+        std::vector<std::uint64_t> inserts;
+        // Pairs of ( index into inserts of the key to remove, new key ) for churn
+        std::vector<std::pair<std::size_t, std::uint64_t>> churn;
+        std::vector<std::uint64_t> lookups;
+    };
+
+    auto make_workloads( std::size_t size, std::uint64_t seed ) -> std::vector<workload_t>
+    {
+        std::mt19937_64 random{ seed };
+        std::vector<workload_t> workloads;
+
+        auto lookups = [&]( std::vector<std::uint64_t> const & keys ) {
+            std::vector<std::uint64_t> result( size );
+            for( auto && key : result ) {
+                key = random() % 2 ? keys[ random() % keys.size() ] : random();
+            }
+            return result;
+        };
+
+        {
+            workload_t workload{ "random", {}, {}, {} };
+            for( std::size_t i = 0; i < size; ++i ) {
+                workload.inserts.push_back( random() );
+            }
+            workload.lookups = lookups( workload.inserts );
+            workloads.push_back( std::move( workload ) );
+        }
+
+        {
+            workload_t workload{ "sorted", {}, {}, {} };
+            for( std::size_t i = 0; i < size; ++i ) {
+                workload.inserts.push_back( i );
+            }
+            workload.lookups = lookups( workload.inserts );
+            workloads.push_back( std::move( workload ) );
+        }
+
+        {
+            workload_t workload{ "zipf", {}, {}, {} };
+            zipf_t zipf{ std::max<std::size_t>( size / 8, 1 ), 1.0 };
+            for( std::size_t i = 0; i < size; ++i ) {
+                workload.inserts.push_back( zipf( random ) * 2654435761u );
+            }
+            workload.lookups = lookups( workload.inserts );
+            workloads.push_back( std::move( workload ) );
+        }
+
+        {
+            workload_t workload{ "churn", {}, {}, {} };
+            for( std::size_t i = 0; i < size; ++i ) {
+                workload.inserts.push_back( random() );
+            }
+            for( std::size_t i = 0; i < size; ++i ) {
+                workload.churn.emplace_back( random() % size, random() );
+            }
+            workload.lookups = lookups( workload.inserts );
+            workloads.push_back( std::move( workload ) );
+        }
+
+        return workloads;
+    }
+
+    struct phase_t
+    {
+        char const * name;
+        std::size_t ops;
+        double seconds;
+        std::uint64_t p50;
+        std::uint64_t p99;
+    };
+
+    auto summarize( char const * name, latency_t & latency ) -> phase_t
+    {
+        return { name, latency.count(), latency.total(), latency.percentile( 0.5 ), latency.percentile( 0.99 ) };
+    }
+
+    struct result_t
+    {
+        std::string structure;
+        std::string key;
+        std::string workload;
+        double bytes_per_element;
+        std::vector<phase_t> phases;
+    };
+
+    template< typename Adapter, typename K >
+    auto run( workload_t const & workload, std::uint64_t seed ) -> result_t
+    {
+        std::vector<K> inserts;
+        for( auto value : workload.inserts ) {
+            inserts.push_back( make_key<K>( value ) );
+        }
+        std::vector<std::pair<std::size_t, K>> churn;
+        for( auto && op : workload.churn ) {
+            churn.emplace_back( op.first, make_key<K>( op.second ) );
+        }
+        std::vector<K> lookups;
+        for( auto value : workload.lookups ) {
+            lookups.push_back( make_key<K>( value ) );
+        }
+
+        result_t result{ Adapter::name(), key_name<K>(), workload.name, 0, {} };
+
+        auto bytes_before = live_bytes;
+        {
+            Adapter adapter;
+
+            latency_t insert{ inserts.size() };
+            for( auto && key : inserts ) {
+                insert.record( [&] { adapter.insert( key ); } );
+            }
+            result.phases.push_back( summarize( "insert", insert ) );
+            result.bytes_per_element = adapter.size() ? double( live_bytes - bytes_before ) / adapter.size() : 0;
+
+            if( !churn.empty() ) {
+                latency_t latency{ churn.size() };
+                for( auto && op : churn ) {
+                    latency.record( [&] {
+                        adapter.remove( inserts[ op.first ] );
+                        adapter.insert( op.second );
+                    } );
+                    inserts[ op.first ] = op.second;
+                }
+                result.phases.push_back( summarize( "churn", latency ) );
+            }
+
+            std::size_t found = 0;
+            latency_t lookup{ lookups.size() };
+            for( auto && key : lookups ) {
+                lookup.record( [&] { found += adapter.contains( key ); } );
+            }
+            result.phases.push_back( summarize( "lookup", lookup ) );
+
+            if( Adapter::has_select && adapter.size() != 0 ) {
+                std::mt19937_64 random{ seed };
+                latency_t select{ lookups.size() };
+                for( std::size_t i = 0; i < lookups.size(); ++i ) {
+                    auto n = random() % adapter.size() + 1;
+                    select.record( [&] { found += adapter.select( n ); } );
+                }
+                result.phases.push_back( summarize( "select", select ) );
+            }
+
+            std::size_t scanned = 0;
+            auto scan = measure( [&] { adapter.scan( [&]( K const & ) { ++scanned; } ); } );
+            result.phases.push_back( { "scan", scanned, scan, 0, 0 } );
+
+            std::shuffle( inserts.begin(), inserts.end(), std::mt19937_64{ seed } );
+            latency_t remove{ inserts.size() };
+            for( auto && key : inserts ) {
+                remove.record( [&] { adapter.remove( key ); } );
+            }
+            result.phases.push_back( summarize( "remove", remove ) );
+
+            sink = found;
+        }
+
+        return result;
+    }
+
+    template< typename K >
+    void run_all( std::vector<workload_t> const & workloads, std::uint64_t seed, std::vector<result_t> & results )
+    {
+        for( auto && workload : workloads ) {
+            results.push_back( run<rb_tree_adapter<K>, K>( workload, seed ) );
+            results.push_back( run<std_adapter<std::multiset<K>>, K>( workload, seed ) );
+            results.push_back( run<std_adapter<std::set<K>>, K>( workload, seed ) );
+        }
+    }
+
+    void write_json( std::ostream & stream, std::size_t size, std::uint64_t seed, std::vector<result_t> const & results )
+    {
+        stream << "{\n  \"size\": " << size << ",\n  \"seed\": " << seed << ",\n  \"results\": [";
+        for( std::size_t i = 0; i < results.size(); ++i ) {
+            auto && result = results[ i ];
+            stream << ( i ? "," : "" ) << "\n    {\n"
+                   << "      \"structure\": \"" << result.structure << "\",\n"
+                   << "      \"key\": \"" << result.key << "\",\n"
+                   << "      \"workload\": \"" << result.workload << "\",\n"
+                   << "      \"bytes_per_element\": " << result.bytes_per_element << ",\n"
+                   << "      \"phases\": {";
+            for( std::size_t j = 0; j < result.phases.size(); ++j ) {
+                auto && phase = result.phases[ j ];
+                stream << ( j ? "," : "" ) << "\n        \"" << phase.name << "\": { "
+                       << "\"ops\": " << phase.ops << ", "
+                       << "\"ops_per_s\": " << ( phase.seconds > 0 ? phase.ops / phase.seconds : 0 ) << ", "
+                       << "\"p50_ns\": " << phase.p50 << ", "
+                       << "\"p99_ns\": " << phase.p99 << " }";
+            }
+            stream << "\n      }\n    }";
+        }
+        stream << "\n  ]\n}\n";
+    }
+
+    void write_summary( std::ostream & stream, std::vector<result_t> const & results )
+    {
+        for( auto && result : results ) {
+            stream << result.structure << '\t' << result.key << '\t' << result.workload
+                   << "\t" << result.bytes_per_element << " B/elem";
+            for( auto && phase : result.phases ) {
+                stream << '\t' << phase.name << ' ' << ( phase.seconds > 0 ? phase.ops / phase.seconds / 1e6 : 0 ) << " Mops/s";
+            }
+            stream << '\n';
+        }
+    }
+}
+
+int main( int argc, const char * argv[] )
+{
+    std::size_t size = std::size_t{ 1 } << 16;
+    std::uint64_t seed = 42;
+    std::string out;
+
+    for( int i = 1; i < argc; ++i ) {
+        std::string arg = argv[ i ];
+        if( arg == "--size" && i + 1 < argc ) {
+            size = std::strtoull( argv[ ++i ], nullptr, 10 );
+        }
+        else if( arg == "--seed" && i + 1 < argc ) {
+            seed = std::strtoull( argv[ ++i ], nullptr, 10 );
+        }
+        else if( arg == "--out" && i + 1 < argc ) {
+            out = argv[ ++i ];
+        }
+        else {
+            std::cerr << "usage: " << argv[ 0 ] << " [--size N] [--seed S] [--out results.json]" << std::endl;
+            return 1;
+        }
+    }
+
+    if( size == 0 ) {
+        std::cerr << "size must be positive" << std::endl;
+        return 1;
+    }
+
+    auto workloads = make_workloads( size, seed );
+
+    std::vector<result_t> results;
+    run_all<int>( workloads, seed, results );
+    run_all<std::string>( workloads, seed, results );
+
+    write_summary( std::cerr, results );
+
+    if( out.empty() ) {
+        write_json( std::cout, size, seed, results );
+    }
+    else {
+        std::ofstream stream{ out };
+        write_json( stream, size, seed, results );
+        if( !stream ) {
+            std::cerr << "cannot write " << out << std::endl;
+            return 1;
+        }
+    }
+
+    return 0;
+}
@@ -0,0 +1,62 @@
+#include <algorithm>
+#include <cstdint>
+#include <cstdlib>
+#include <iostream>
+#include <random>
+#include <vector>
+
+#include "benchmark.hpp"
+#include "rb_tree.hpp"
+
+// Compares bottom-up insert/remove, which climb back through parent links,
+// against the single-pass top-down variants.
+
+int main( int argc, const char * argv[] )
+{
+    std::size_t max_size = argc > 1 ? std::strtoull( argv[ 1 ], nullptr, 10 ) : std::size_t{ 1 } << 20;
+    
+    std::mt19937_64 random{ 42 };
+    std::cout << "size\tbottom-up insert\ttop-down insert\tbottom-up remove\ttop-down remove\t(Mops/s)\n";
+    
+    for( std::size_t size = std::size_t{ 1 } << 10; size <= max_size; size <<= 2 ) {
+        std::vector<std::uint64_t> keys( size );
+        for( auto && key : keys ) {
+            key = random();
+        }
+        
+        rb_tree_t<std::uint64_t> bottom_up;
+        rb_tree_t<std::uint64_t> top_down;
+        
+        auto bottom_up_insert = measure( [&] {
+            for( auto key : keys ) {
+                bottom_up.insert( key );
+            }
+        } );
+        auto top_down_insert = measure( [&] {
+            for( auto key : keys ) {
+                top_down.insert_top_down( key );
+            }
+        } );
+        
+        std::shuffle( keys.begin(), keys.end(), random );
+        
+        auto bottom_up_remove = measure( [&] {
+            for( auto key : keys ) {
+                bottom_up.remove( key );
+            }
+        } );
+        auto top_down_remove = measure( [&] {
+            for( auto key : keys ) {
+                top_down.remove_top_down( key );
+            }
+        } );
+        
+        std::cout << size
+                  << '\t' << size / bottom_up_insert / 1e6
+                  << '\t' << size / top_down_insert / 1e6
+                  << '\t' << size / bottom_up_remove / 1e6
+                  << '\t' << size / top_down_remove / 1e6 << std::endl;
+    }
+    
+    return 0;
+}
@@ -1,34 +1,327 @@
+#include <algorithm>
+#include <chrono>
+#include <cstdint>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
 #include <iostream>
-#include <sstream>
+#include <limits>
+#include <memory>
+#include <vector>
 
 #include "rb_tree.hpp"
 
-int main(int argc, const char * argv[]) 
+// Replays a log of operations against rb_tree_t<int>.
+//
+// Text input has one operation per line:
+//   + key    insert key
+//   - key    remove key
+//   ? key    print 1 if key is present, 0 otherwise
+//   # n      print n-th key in order starting from 1, or - if n is out of range
+//   r key    print number of keys less than key
+// Binary input (--binary) is a sequence of 5-byte records: the operation character followed by
+// the key as a native 32-bit integer. Any other operation ends the replay.
+//
+// A number out of the range of int makes the operation ignored, like a missing number.
+//
+// Usage: main [--binary] [--quiet] [--no-print] [--batch n] [--report n] [file]
+//   --quiet     print nothing to stdout: neither answers of ?, # and r nor the tree
+//   --no-print  do not print the tree after every + and -, which makes every such operation O(n)
+//   --batch n   operations parsed ahead and executed together, runs of ? use find_many
+//   --report n  write throughput and latency to stderr every n operations and at the end
+
+namespace
 {
-    
-    rb_tree_t<int> tree;
-    for( std::string line; std::getline( std::cin, line ); ) {
-        std::istringstream stream{ line };
+    struct command_t
+    {
         char op;
-        if( stream >> op ) {
-            if( op == '+' ) {
-                if( int number; stream >> number ) {
-                    tree.insert( number );
-                    std::cout << tree << std::endl;
+        int value;
+    };
+
+    /**
+     * @brief Reads commands from a file through a fixed buffer without allocations per command.
+     */
+    class reader_t
+    {
+    public:
+        reader_t( std::FILE * file, bool binary ) : file_{ file }, binary_{ binary }
+        {
+        }
+
+        bool next( command_t & command )
+        {
+            return binary_ ? next_binary( command ) : next_text( command );
+        }
+
+    private:
+        static std::size_t const BufferSize = 1 << 16;
+
+        std::FILE * file_;
+        bool binary_;
+        char buffer_[ BufferSize ];
+        std::size_t begin_ = 0;
+        std::size_t end_ = 0;
+
+        // Keeps unread bytes and fills the rest of the buffer, returns number of available bytes.
+        auto fill( std::size_t needed ) -> std::size_t
+        {
+            if( end_ - begin_ < needed ) {
+                std::memmove( buffer_, buffer_ + begin_, end_ - begin_ );
+                end_ -= begin_;
+                begin_ = 0;
+                end_ += std::fread( buffer_ + end_, 1, BufferSize - end_, file_ );
+            }
+
+            return end_ - begin_;
+        }
+
+        int peek()
+        {
+            return fill( 1 ) ? static_cast<unsigned char>( buffer_[ begin_ ] ) : EOF;
+        }
+
+        bool next_binary( command_t & command )
+        {
+            std::int32_t value;
+            if( fill( 1 + sizeof( value ) ) < 1 + sizeof( value ) ) {
+                return false;
+            }
+
+            command.op = buffer_[ begin_ ];
+            std::memcpy( &value, buffer_ + begin_ + 1, sizeof( value ) );
+            command.value = value;
+            begin_ += 1 + sizeof( value );
+
+            return true;
+        }
+
+        bool next_text( command_t & command )
+        {
+            for( ;; ) {
+                auto c = peek();
+                while( c == ' ' || c == '\t' || c == '\r' || c == '\n' ) {
+                    ++begin_;
+                    c = peek();
                 }
+                if( c == EOF ) {
+                    return false;
+                }
+
+                command.op = buffer_[ begin_++ ];
+                auto parsed = next_number( command.value );
+                skip_line();
+
+                // Like std::istream, an operation without a number is ignored
+                auto known = command.op == '+' || command.op == '-' || command.op == '?' ||
+                             command.op == '#' || command.op == 'r';
+                if( parsed || !known ) {
+                    return true;
+                }
+            }
+        }
+
+        bool next_number( int & value )
+        {
+            auto c = peek();
+            while( c == ' ' || c == '\t' ) {
+                ++begin_;
+                c = peek();
             }
-            else if ( op == '-' ) {
-                if( int number; stream >> number ) {
-                    tree.remove( number );
-                    std::cout << tree << std::endl;
+
+            auto negative = c == '-';
+            if( negative || c == '+' ) {
+                ++begin_;
+                c = peek();
+            }
+
+            if( c < '0' || c > '9' ) {
+                return false;
+            }
+
+            // Magnitude of INT_MIN fits, the sign is applied last
+            auto const limit = static_cast<long long>( std::numeric_limits<int>::max() ) + negative;
+            long long result = 0;
+            auto overflow = false;
+            for( ; c >= '0' && c <= '9'; c = peek() ) {
+                result = result * 10 + ( c - '0' );
+                if( result > limit ) {
+                    overflow = true;
+                    result = limit;
+                }
+                ++begin_;
+            }
+            if( overflow ) {
+                return false;
+            }
+            value = static_cast<int>( negative ? -result : result );
+
+            return true;
+        }
+
+        void skip_line()
+        {
+            for( auto c = peek(); c != EOF && c != '\n'; c = peek() ) {
+                ++begin_;
+            }
+        }
+    };
+
+    using steady_t = std::chrono::steady_clock;
+
+    auto elapsed( steady_t::time_point start, steady_t::time_point stop ) -> std::uint64_t
+    {
+        return std::chrono::duration_cast<std::chrono::nanoseconds>( stop - start ).count();
+    }
+
+    void report( char const * title, rb_tree_latency_t const & latency, double seconds, std::size_t size )
+    {
+        std::cerr << title << ": ops " << latency.count()
+                  << " ops/s " << static_cast<std::uint64_t>( seconds > 0 ? latency.count() / seconds : 0 )
+                  << " p50 <= " << latency.percentile( 0.5 ) << "ns"
+                  << " p99 <= " << latency.percentile( 0.99 ) << "ns"
+                  << " size " << size << std::endl;
+    }
+}
+
+int main( int argc, const char * argv[] )
+{
+    bool binary = false;
+    bool quiet = false;
+    bool print = true;
+    std::size_t batch = 1;
+    std::size_t period = 0;
+    char const * path = nullptr;
+
+    for( int i = 1; i < argc; ++i ) {
+        auto has_value = i + 1 < argc;
+        if( std::strcmp( argv[ i ], "--binary" ) == 0 ) {
+            binary = true;
+        }
+        else if( std::strcmp( argv[ i ], "--quiet" ) == 0 ) {
+            quiet = true;
+            print = false;
+        }
+        else if( std::strcmp( argv[ i ], "--no-print" ) == 0 ) {
+            print = false;
+        }
+        else if( std::strcmp( argv[ i ], "--batch" ) == 0 && has_value ) {
+            batch = std::strtoull( argv[ ++i ], nullptr, 10 );
+            batch = batch ? batch : 1;
+        }
+        else if( std::strcmp( argv[ i ], "--report" ) == 0 && has_value ) {
+            period = std::strtoull( argv[ ++i ], nullptr, 10 );
+        }
+        else if( argv[ i ][ 0 ] != '-' && !path ) {
+            path = argv[ i ];
+        }
+        else {
+            std::cerr << "usage: " << argv[ 0 ] << " [--binary] [--quiet] [--no-print] [--batch n] [--report n] [file]" << std::endl;
+            return 1;
+        }
+    }
+
+    auto file = path ? std::fopen( path, binary ? "rb" : "r" ) : stdin;
+    if( !file ) {
+        std::cerr << "cannot open " << path << std::endl;
+        return 1;
+    }
+
+    std::ios::sync_with_stdio( false );
+
+    rb_tree_t<int> tree;
+    std::unique_ptr<reader_t> reader{ new reader_t{ file, binary } };
+    std::vector<command_t> commands( batch );
+    std::vector<int> keys( batch );
+    std::unique_ptr<bool[]> found{ new bool[ batch ] };
+
+    rb_tree_latency_t total;
+    rb_tree_latency_t interval;
+    auto start = steady_t::now();
+    auto interval_start = start;
+
+    for( auto done = false; !done; ) {
+        std::size_t size = 0;
+        while( size < batch && reader->next( commands[ size ] ) ) {
+            ++size;
+        }
+        done = size < batch;
+
+        for( std::size_t i = 0; i < size; ) {
+            auto & command = commands[ i ];
+            auto before = steady_t::now();
+            auto executed = std::size_t( 1 );
+
+            if( command.op == '+' ) {
+                tree.insert( command.value );
+                if( print ) {
+                    std::cout << tree << '\n';
+                }
+            }
+            else if( command.op == '-' ) {
+                tree.remove( command.value );
+                if( print ) {
+                    std::cout << tree << '\n';
+                }
+            }
+            else if( command.op == '?' ) {
+                // Consecutive lookups overlap their cache misses in find_many
+                auto last = i;
+                for( ; last < size && commands[ last ].op == '?'; ++last ) {
+                    keys[ last - i ] = commands[ last ].value;
+                }
+                executed = last - i;
+                tree.find_many( keys.begin(), keys.begin() + executed, found.get() );
+                if( !quiet ) {
+                    for( std::size_t j = 0; j < executed; ++j ) {
+                        std::cout << found[ j ] << '\n';
+                    }
+                }
+            }
+            else if( command.op == '#' ) {
+                int key;
+                auto selected = command.value > 0 && tree.select( std::size_t( command.value ), key );
+                if( !quiet ) {
+                    if( selected ) {
+                        std::cout << key << '\n';
+                    }
+                    else {
+                        std::cout << "-\n";
+                    }
+                }
+            }
+            else if( command.op == 'r' ) {
+                auto rank = tree.rank( command.value );
+                if( !quiet ) {
+                    std::cout << rank << '\n';
                 }
             }
             else {
+                done = true;
                 break;
             }
+
+            auto ns = elapsed( before, steady_t::now() );
+            total.record( ns / executed, executed );
+            interval.record( ns / executed, executed );
+            i += executed;
+
+            if( period && interval.count() >= period ) {
+                auto now = steady_t::now();
+                report( "interval", interval, elapsed( interval_start, now ) * 1e-9, tree.size() );
+                interval.reset();
+                interval_start = now;
+            }
         }
     }
-    
+
+    std::cout.flush();
+    if( period ) {
+        report( "total", total, elapsed( start, steady_t::now() ) * 1e-9, tree.size() );
+    }
+
+    if( path ) {
+        std::fclose( file );
+    }
+
     return 0;
 }
-
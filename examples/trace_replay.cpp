@@ -0,0 +1,431 @@
+#include <algorithm>
+#include <cstdint>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <iomanip>
+#include <iostream>
+#include <random>
+#include <string>
+#include <vector>
+
+#include <sys/resource.h>
+#include <sys/wait.h>
+#include <unistd.h>
+
+#include "rb_tree.hpp"
+#include "rb_tree_snapshot.hpp"
+#include "rb_tree_trace.hpp"
+
+// Records operation traces of rb_tree_t<std::int64_t> and replays them against its configurations.
+//
+// Usage:
+//   trace_replay record trace [--ops n] [--keys n] [--seed s] [--read-only]
+//       writes a synthetic workload through rb_tree_trace_recorder_t: 40% inserts, 20% removes,
+//       25% lookups, 10% selects and 5% ranks of keys drawn from [0, keys). With --read-only, every
+//       key is inserted first and the operations are lookups, selects and ranks only
+//   trace_replay replay trace [--configs a,b,...]
+//       replays the trace against every configuration in its own process and prints throughput,
+//       latency percentiles, the peak of memory_usage() and the growth of peak RSS. Unknown
+//       configuration names are an error
+//
+// Configurations:
+//   default   insert() and remove()
+//   top-down  insert_top_down() and remove_top_down()
+//   compact   default, with compact() after every CompactPeriod inserts and removes
+//   lazy      default, with lazy_remove( 0.25, 32 )
+//   snapshot  default until the first query, which saves the tree and maps it with rb_tree_snapshot_t;
+//             skipped if the trace changes keys after its first query
+// Every configuration must produce the same checksum of answers.
+
+namespace
+{
+    using key_t = std::int64_t;
+    using record_t = rb_tree_trace_record_t<key_t>;
+
+    std::size_t const CompactPeriod = 1 << 16;
+    char const * const Configs = "default,top-down,compact,lazy,snapshot";
+
+    struct top_down_target_t : rb_tree_trace_target_t<key_t>
+    {
+        void insert( key_t const & key )
+        {
+            tree.insert_top_down( key );
+        }
+
+        void remove( key_t const & key )
+        {
+            tree.remove_top_down( key );
+        }
+    };
+
+    struct compact_target_t : rb_tree_trace_target_t<key_t>
+    {
+        std::size_t changes = 0;
+
+        void insert( key_t const & key )
+        {
+            tree.insert( key );
+            changed();
+        }
+
+        void remove( key_t const & key )
+        {
+            tree.remove( key );
+            changed();
+        }
+
+        void changed()
+        {
+            if( ++changes % CompactPeriod == 0 ) {
+                tree.compact();
+            }
+        }
+    };
+
+    // Changes keys in a tree until the first query, which saves the tree and maps it
+    struct snapshot_target_t : rb_tree_trace_target_t<key_t>
+    {
+        rb_tree_snapshot_t<key_t> snapshot;
+        bool frozen = false;
+        bool failed = false;
+
+        bool contains( key_t const & key )
+        {
+            freeze();
+            return snapshot.contains( key );
+        }
+
+        bool select( std::size_t n, key_t & key )
+        {
+            freeze();
+            auto found = snapshot.select( n );
+            if( found ) {
+                key = *found;
+            }
+            return found != nullptr;
+        }
+
+        auto rank( key_t const & key ) -> std::size_t
+        {
+            freeze();
+            return snapshot.rank( key );
+        }
+
+        auto memory() -> std::size_t
+        {
+            return frozen ? snapshot.size() * sizeof( key_t ) : tree.memory_usage().total();
+        }
+
+        void freeze()
+        {
+            if( frozen ) {
+                return;
+            }
+
+            frozen = true;
+            auto path = "trace_replay." + std::to_string( getpid() ) + ".snapshot";
+            failed = !tree.save( path ) || !snapshot.open( path );
+            // The mapping stays valid without the file
+            std::remove( path.c_str() );
+            tree.clear();
+        }
+    };
+
+    // Sent from the process running a configuration to the one printing the table
+    struct summary_t
+    {
+        bool done;
+        std::uint64_t ops;
+        double seconds;
+        std::uint64_t p50;
+        std::uint64_t p99;
+        std::uint64_t p999;
+        std::uint64_t op_p99[ 5 ];
+        std::uint64_t peak_bytes;
+        std::uint64_t rss_growth;
+        std::uint64_t checksum;
+    };
+
+    // Peak resident set size of this process in KiB
+    auto peak_rss() -> std::uint64_t
+    {
+        rusage usage;
+        getrusage( RUSAGE_SELF, &usage );
+        return std::uint64_t( usage.ru_maxrss );
+    }
+
+    auto summarize( rb_tree_replay_result_t const & result, std::uint64_t rss_before ) -> summary_t
+    {
+        summary_t summary;
+        std::memset( &summary, 0, sizeof( summary ) );
+        summary.done = true;
+        summary.ops = result.latency.count();
+        summary.seconds = result.seconds;
+        summary.p50 = result.latency.percentile( 0.5 );
+        summary.p99 = result.latency.percentile( 0.99 );
+        summary.p999 = result.latency.percentile( 0.999 );
+        for( std::size_t op = 0; op < 5; ++op ) {
+            summary.op_p99[ op ] = result.op_latency[ op ].percentile( 0.99 );
+        }
+        summary.peak_bytes = result.peak_bytes;
+        summary.rss_growth = peak_rss() - rss_before;
+        summary.checksum = result.checksum;
+        return summary;
+    }
+
+    template< typename Target >
+    auto run( std::vector<record_t> const & records ) -> summary_t
+    {
+        auto rss_before = peak_rss();
+        Target target;
+        return summarize( rb_tree_trace_replay( records, target ), rss_before );
+    }
+
+    auto run_snapshot( std::vector<record_t> const & records ) -> summary_t
+    {
+        summary_t skipped;
+        std::memset( &skipped, 0, sizeof( skipped ) );
+
+        auto query = std::find_if( records.begin(), records.end(), []( record_t const & record ) {
+            return record.op != '+' && record.op != '-';
+        } );
+        auto change = std::find_if( query, records.end(), []( record_t const & record ) {
+            return record.op == '+' || record.op == '-';
+        } );
+        if( change != records.end() ) {
+            return skipped;
+        }
+
+        auto rss_before = peak_rss();
+        snapshot_target_t target;
+        auto result = rb_tree_trace_replay( records, target );
+        return target.failed ? skipped : summarize( result, rss_before );
+    }
+
+    auto run_config( std::string const & config, std::vector<record_t> const & records ) -> summary_t
+    {
+        if( config == "default" ) {
+            return run<rb_tree_trace_target_t<key_t>>( records );
+        }
+        if( config == "top-down" ) {
+            return run<top_down_target_t>( records );
+        }
+        if( config == "compact" ) {
+            return run<compact_target_t>( records );
+        }
+        if( config == "lazy" ) {
+            struct lazy_target_t : rb_tree_trace_target_t<key_t>
+            {
+                lazy_target_t()
+                {
+                    tree.lazy_remove( 0.25, 32 );
+                }
+            };
+            return run<lazy_target_t>( records );
+        }
+        if( config == "snapshot" ) {
+            return run_snapshot( records );
+        }
+
+        summary_t unknown;
+        std::memset( &unknown, 0, sizeof( unknown ) );
+        return unknown;
+    }
+
+    /**
+     * @brief Runs a configuration in a child process so peak RSS is measured per configuration.
+     */
+    auto run_isolated( std::string const & config, std::vector<record_t> const & records ) -> summary_t
+    {
+        summary_t summary;
+        std::memset( &summary, 0, sizeof( summary ) );
+
+        int channel[ 2 ];
+        if( pipe( channel ) != 0 ) {
+            return summary;
+        }
+
+        auto child = fork();
+        if( child == 0 ) {
+            close( channel[ 0 ] );
+            summary = run_config( config, records );
+            auto written = write( channel[ 1 ], &summary, sizeof( summary ) );
+            _exit( written == sizeof( summary ) ? 0 : 1 );
+        }
+
+        close( channel[ 1 ] );
+        if( child > 0 ) {
+            if( read( channel[ 0 ], &summary, sizeof( summary ) ) != sizeof( summary ) ) {
+                summary.done = false;
+            }
+            waitpid( child, nullptr, 0 );
+        }
+        close( channel[ 0 ] );
+
+        return summary;
+    }
+
+    int record( std::string const & path, std::size_t ops, std::size_t keys, std::uint64_t seed, bool read_only )
+    {
+        rb_tree_trace_writer_t<key_t> writer;
+        if( !writer.open( path ) ) {
+            std::cerr << "cannot write " << path << std::endl;
+            return 1;
+        }
+
+        rb_tree_t<key_t> tree;
+        rb_tree_trace_recorder_t<key_t> recorder{ tree, writer };
+        std::mt19937_64 random{ seed };
+        if( read_only ) {
+            for( std::size_t key = 0; key < keys; ++key ) {
+                recorder.insert( key_t( key ) );
+            }
+        }
+        for( std::size_t i = 0; i < ops; ++i ) {
+            auto key = key_t( random() % keys );
+            auto dice = read_only ? 60 + random() % 40 : random() % 100;
+            if( dice < 40 ) {
+                recorder.insert( key );
+            }
+            else if( dice < 60 ) {
+                recorder.remove( key );
+            }
+            else if( dice < 85 ) {
+                recorder.contains( key );
+            }
+            else if( dice < 95 ) {
+                recorder.select( tree.size() ? 1 + random() % tree.size() : 0 );
+            }
+            else {
+                recorder.rank( key );
+            }
+        }
+
+        if( !writer.close() ) {
+            std::cerr << "cannot write " << path << std::endl;
+            return 1;
+        }
+
+        std::cerr << "recorded " << ops << " operations, " << tree.size() << " keys left" << std::endl;
+        return 0;
+    }
+
+    int replay( std::string const & path, std::vector<std::string> const & configs )
+    {
+        std::vector<record_t> records;
+        if( !rb_tree_trace_load( path, records ) ) {
+            std::cerr << "cannot read trace " << path << std::endl;
+            return 1;
+        }
+
+        // Latencies in ns, rounded up to powers of two
+        std::cout << "config\tops/s\tp50\tp99\tp99.9\tp99 +\tp99 -\tp99 ?\tp99 #\tp99 r"
+                  << "\tpeak tree KiB\tRSS growth KiB\tchecksum\n";
+
+        std::uint64_t expected = 0;
+        auto first = true;
+        auto consistent = true;
+        for( auto && config : configs ) {
+            auto summary = run_isolated( config, records );
+            if( !summary.done ) {
+                std::cout << config << "\tskipped\n";
+                continue;
+            }
+
+            std::cout << config
+                      << '\t' << std::uint64_t( summary.seconds > 0 ? summary.ops / summary.seconds : 0 )
+                      << '\t' << summary.p50 << '\t' << summary.p99 << '\t' << summary.p999;
+            for( auto p99 : summary.op_p99 ) {
+                std::cout << '\t' << p99;
+            }
+            std::cout << '\t' << summary.peak_bytes / 1024 << '\t' << summary.rss_growth
+                      << '\t' << std::hex << summary.checksum << std::dec << std::endl;
+
+            consistent = consistent && ( first || expected == summary.checksum );
+            expected = summary.checksum;
+            first = false;
+        }
+
+        if( !consistent ) {
+            std::cerr << "configurations disagree on the answers" << std::endl;
+            return 1;
+        }
+        return 0;
+    }
+
+    auto split( std::string const & list ) -> std::vector<std::string>
+    {
+        std::vector<std::string> result;
+        std::size_t begin = 0;
+        for( auto end = list.find( ',' ); ; end = list.find( ',', begin ) ) {
+            result.push_back( list.substr( begin, end - begin ) );
+            if( end == std::string::npos ) {
+                return result;
+            }
+            begin = end + 1;
+        }
+    }
+
+    int usage( char const * name )
+    {
+        std::cerr << "usage: " << name << " record trace [--ops n] [--keys n] [--seed s] [--read-only]\n"
+                  << "       " << name << " replay trace [--configs " << Configs << "]" << std::endl;
+        return 1;
+    }
+}
+
+int main( int argc, const char * argv[] )
+{
+    if( argc < 3 ) {
+        return usage( argv[ 0 ] );
+    }
+
+    std::string const mode = argv[ 1 ];
+    std::string const path = argv[ 2 ];
+    std::size_t ops = 1000000;
+    std::size_t keys = 100000;
+    std::uint64_t seed = 42;
+    auto read_only = false;
+    auto configs = split( Configs );
+
+    for( int i = 3; i < argc; ++i ) {
+        auto has_value = i + 1 < argc;
+        if( std::strcmp( argv[ i ], "--ops" ) == 0 && has_value ) {
+            ops = std::strtoull( argv[ ++i ], nullptr, 10 );
+        }
+        else if( std::strcmp( argv[ i ], "--keys" ) == 0 && has_value ) {
+            keys = std::strtoull( argv[ ++i ], nullptr, 10 );
+            keys = keys ? keys : 1;
+        }
+        else if( std::strcmp( argv[ i ], "--seed" ) == 0 && has_value ) {
+            seed = std::strtoull( argv[ ++i ], nullptr, 10 );
+        }
+        else if( std::strcmp( argv[ i ], "--read-only" ) == 0 ) {
+            read_only = true;
+        }
+        else if( std::strcmp( argv[ i ], "--configs" ) == 0 && has_value ) {
+            configs = split( argv[ ++i ] );
+            // A misspelled name would silently drop a configuration from the comparison
+            auto known = split( Configs );
+            for( auto && config : configs ) {
+                if( std::find( known.begin(), known.end(), config ) == known.end() ) {
+                    std::cerr << "unknown configuration " << config << std::endl;
+                    return usage( argv[ 0 ] );
+                }
+            }
+        }
+        else {
+            return usage( argv[ 0 ] );
+        }
+    }
+
+    if( mode == "record" ) {
+        return record( path, ops, keys, seed, read_only );
+    }
+    if( mode == "replay" ) {
+        return replay( path, configs );
+    }
+
+    return usage( argv[ 0 ] );
+}
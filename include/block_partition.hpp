@@ -0,0 +1,141 @@
+#ifndef BLOCK_PARTITION_HPP
+#define BLOCK_PARTITION_HPP
+
+#include <algorithm>
+#include <cstddef>
+#include <iterator>
+#include <utility>
+
+#include "partition.hpp"
+
+// Three-way partition of a random-access range without branches on comparison outcomes,
+// following BlockQuicksort (Edelkamp, Weiss).
+//
+// The range is split twice: first into < pivot and the rest, then the rest into == pivot and > pivot.
+// Each split scans a block at both ends and stores offsets of misplaced elements into small buffers,
+// the offset is always written and the counter advanced by the comparison result. Misplaced
+// elements of both buffers are then swapped pairwise. Only the last two blocks are partitioned
+// with branches.
+
+namespace block_partition_detail
+{
+    // Number of elements scanned at once on each side
+    static std::size_t const BlockSize = 64;
+
+    // Elements less than pivot go to the left side
+    struct less_side_t
+    {
+        template< typename T, typename U >
+        static bool test( T const & value, U const & pivot )
+        {
+            return value < pivot;
+        }
+    };
+
+    // Elements not greater than pivot go to the left side
+    struct not_greater_side_t
+    {
+        template< typename T, typename U >
+        static bool test( T const & value, U const & pivot )
+        {
+            return !( pivot < value );
+        }
+    };
+
+    /**
+     * @brief Moves elements of the left side before the others.
+     *
+     * @return Iterator past the last element of the left side.
+     */
+    template< typename Side, typename _RandomAccessIterator, typename T >
+    auto split( _RandomAccessIterator first, _RandomAccessIterator last, T const & pivot ) -> _RandomAccessIterator
+    {
+        using difference_t = typename std::iterator_traits<_RandomAccessIterator>::difference_type;
+        difference_t const block = BlockSize;
+
+        unsigned char offsets_left[ BlockSize ];
+        unsigned char offsets_right[ BlockSize ];
+        difference_t count_left = 0;
+        difference_t count_right = 0;
+        difference_t start_left = 0;
+        difference_t start_right = 0;
+
+        // Elements before first belong to the left side, elements from last on to the right side
+        while( last - first > 2 * block ) {
+            if( count_left == 0 ) {
+                start_left = 0;
+                for( difference_t i = 0; i < block; ++i ) {
+                    offsets_left[ count_left ] = static_cast<unsigned char>( i );
+                    count_left += !Side::test( first[ i ], pivot );
+                }
+            }
+            if( count_right == 0 ) {
+                start_right = 0;
+                for( difference_t i = 0; i < block; ++i ) {
+                    offsets_right[ count_right ] = static_cast<unsigned char>( i );
+                    count_right += Side::test( last[ -1 - i ], pivot );
+                }
+            }
+
+            auto count = std::min( count_left, count_right );
+            for( difference_t i = 0; i < count; ++i ) {
+                std::iter_swap( first + offsets_left[ start_left + i ], last - 1 - offsets_right[ start_right + i ] );
+            }
+
+            count_left -= count;
+            count_right -= count;
+            start_left += count;
+            start_right += count;
+
+            if( count_left == 0 ) {
+                first += block;
+            }
+            if( count_right == 0 ) {
+                last -= block;
+            }
+        }
+
+        // At most two blocks are left, one of them possibly with unswapped offsets
+        for( ;; ) {
+            while( first != last && Side::test( *first, pivot ) ) {
+                ++first;
+            }
+            if( first == last ) {
+                break;
+            }
+
+            --last;
+            while( first != last && !Side::test( *last, pivot ) ) {
+                --last;
+            }
+            if( first == last ) {
+                break;
+            }
+
+            std::iter_swap( first, last );
+            ++first;
+        }
+
+        return first;
+    }
+}
+
+/**
+ * @brief Three-way partition of a random-access range with branch-free classification.
+ *
+ * Works with any random-access iterator including raw pointers. Elements are compared with
+ * operator < like in hoare_partition, the order of elements inside each part is unspecified.
+ *
+ * @return Ranges of elements less than, equal to and greater than pivot.
+ */
+template< typename _RandomAccessIterator, typename T >
+auto block_partition( _RandomAccessIterator first, _RandomAccessIterator last, T pivot )
+    -> parition_t<_RandomAccessIterator>
+{
+    auto equal = block_partition_detail::split<block_partition_detail::less_side_t>( first, last, pivot );
+    auto great = block_partition_detail::split<block_partition_detail::not_greater_side_t>( equal, last, pivot );
+
+    return {{first, equal - first}, {equal, great - equal}, {great, last - great}};
+}
+
+#endif
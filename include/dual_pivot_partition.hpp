@@ -0,0 +1,54 @@
+#ifndef DUAL_PIVOT_PARTITION_HPP
+#define DUAL_PIVOT_PARTITION_HPP
+
+#include <algorithm>
+#include <iterator>
+#include <utility>
+
+#include "partition.hpp"
+
+// first       lower        upper              last
+//   |           |            |                 |
+//   v           v            v                 v
+//+-----+-----+-----+-----+-----+-----+-----+
+//| <p1 | <p1 | p1..p2 | p1..p2 | >p2 | >p2 |
+//+-----+-----+-----+-----+-----+-----+-----+
+
+/**
+ * @brief Splits a range into three parts by two pivots in one pass.
+ *
+ * Pivots must satisfy !( pivot2 < pivot1 ). With equal pivots this is a three-way partition.
+ *
+ * @return Ranges of elements less than pivot1, between pivots inclusive, and greater than pivot2,
+ * stored as less, equal and great.
+ */
+template< typename _BidirectionalIterator, typename T >
+auto dual_pivot_partition( _BidirectionalIterator first, _BidirectionalIterator last, T pivot1, T pivot2 )
+    -> parition_t<_BidirectionalIterator>
+{
+    typename std::iterator_traits<_BidirectionalIterator>::difference_type less_count = 0;
+    typename std::iterator_traits<_BidirectionalIterator>::difference_type middle_count = 0;
+    typename std::iterator_traits<_BidirectionalIterator>::difference_type great_count = 0;
+
+    auto lower = first;
+    auto current = first;
+    auto upper = last;
+    while( current != upper ) {
+        if( *current < pivot1 ) {
+            std::iter_swap( current++, lower++ );
+            ++less_count;
+        }
+        else if( pivot2 < *current ) {
+            std::iter_swap( current, --upper );
+            ++great_count;
+        }
+        else {
+            ++current;
+            ++middle_count;
+        }
+    }
+
+    return {{first, less_count}, {lower, middle_count}, {upper, great_count}};
+}
+
+#endif
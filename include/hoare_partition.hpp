@@ -2,6 +2,7 @@
 #define HOARE_PARTITION_HPP
 
 #include <algorithm>
+#include <iterator>
 #include <utility>
 
 #include "partition.hpp"
@@ -18,9 +19,9 @@ auto hoare_partition( _BidirectionalIterator first, _BidirectionalIterator last,
     auto k = first;
     auto j = last;
 
-    typename _BidirectionalIterator::difference_type less_count = 0;
-    typename _BidirectionalIterator::difference_type equal_count = 0;
-    typename _BidirectionalIterator::difference_type great_count = 0;
+    typename std::iterator_traits<_BidirectionalIterator>::difference_type less_count = 0;
+    typename std::iterator_traits<_BidirectionalIterator>::difference_type equal_count = 0;
+    typename std::iterator_traits<_BidirectionalIterator>::difference_type great_count = 0;
     
     while( i != j ) {
         while( i != j && !(pivot < *i) ) {
@@ -0,0 +1,219 @@
+#ifndef INTRO_SORT_HPP
+#define INTRO_SORT_HPP
+
+#include <algorithm>
+#include <cstddef>
+#include <iterator>
+#include <utility>
+
+#include "partition.hpp"
+#include "simd_partition.hpp"
+
+// Selection and sorting of random-access ranges built on the three-way partitions.
+//
+// Every step splits the range into < pivot, == pivot and > pivot with simd_partition, which uses
+// vector instructions for pointers and std::vector iterators over arithmetic elements and
+// block_partition otherwise. The part equal to the pivot is never visited again, so ranges with few
+// distinct keys take linear time. A step first looks for an ascending or descending run over the
+// whole range, which ends the step without partitioning; on other input the scan stops after a few
+// elements. Pivots are the median of 3 elements, or the ninther on large ranges. After too many
+// unbalanced steps heap sort takes over to keep O(n log n), short ranges are finished by insertion sort.
+
+namespace intro_sort_detail
+{
+    // Ranges up to this size are sorted by insertion
+    static std::ptrdiff_t const InsertionSortSize = 24;
+    // Ranges from this size on take the ninther as pivot
+    static std::ptrdiff_t const NintherSize = 128;
+
+    template< typename _RandomAccessIterator >
+    void insertion_sort( _RandomAccessIterator first, _RandomAccessIterator last )
+    {
+        if( first == last ) {
+            return;
+        }
+
+        for( auto i = std::next( first ); i != last; ++i ) {
+            auto value = std::move( *i );
+            auto j = i;
+            for( ; j != first && value < *std::prev( j ); --j ) {
+                *j = std::move( *std::prev( j ) );
+            }
+            *j = std::move( value );
+        }
+    }
+
+    template< typename _RandomAccessIterator >
+    void heap_sort( _RandomAccessIterator first, _RandomAccessIterator last )
+    {
+        std::make_heap( first, last );
+        std::sort_heap( first, last );
+    }
+
+    template< typename _RandomAccessIterator >
+    auto median( _RandomAccessIterator a, _RandomAccessIterator b, _RandomAccessIterator c ) -> _RandomAccessIterator
+    {
+        if( *a < *b ) {
+            return *b < *c ? b : ( *a < *c ? c : a );
+        }
+
+        return *a < *c ? a : ( *b < *c ? c : b );
+    }
+
+    template< typename _RandomAccessIterator >
+    auto pivot( _RandomAccessIterator first, _RandomAccessIterator last )
+        -> typename std::iterator_traits<_RandomAccessIterator>::value_type
+    {
+        auto size = last - first;
+        auto middle = first + size / 2;
+        auto back = last - 1;
+        if( size < NintherSize ) {
+            return *median( first, middle, back );
+        }
+
+        auto step = size / 8;
+        return *median( median( first, first + step, first + 2 * step ),
+                        median( middle - step, middle, middle + step ),
+                        median( back - 2 * step, back - step, back ) );
+    }
+
+    // Twice the binary logarithm of size, the number of steps allowed before heap sort
+    template< typename Difference >
+    auto depth_limit( Difference size ) -> std::size_t
+    {
+        std::size_t depth = 0;
+        for( ; size > 1; size >>= 1 ) {
+            depth += 2;
+        }
+
+        return depth;
+    }
+
+    /**
+     * @brief Sorts a range made of one ascending or descending run.
+     *
+     * @return false if the range is not a run, it is left unchanged then.
+     */
+    template< typename _RandomAccessIterator >
+    bool sort_run( _RandomAccessIterator first, _RandomAccessIterator last )
+    {
+        using value_t = typename std::iterator_traits<_RandomAccessIterator>::value_type;
+        auto ascending = std::is_sorted_until( first, last, []( value_t const & lhs, value_t const & rhs ) { return lhs < rhs; } );
+        if( ascending == last ) {
+            return true;
+        }
+        // A descending run can only start with equal keys
+        if( *first < *std::prev( ascending ) ) {
+            return false;
+        }
+
+        // The run is reversed only if it never ascends, equal keys may follow each other
+        if( std::is_sorted_until( first, last, []( value_t const & lhs, value_t const & rhs ) { return rhs < lhs; } ) != last ) {
+            return false;
+        }
+
+        std::reverse( first, last );
+        return true;
+    }
+
+    template< typename _RandomAccessIterator >
+    void sort_loop( _RandomAccessIterator first, _RandomAccessIterator last, std::size_t depth )
+    {
+        while( last - first > InsertionSortSize ) {
+            if( depth == 0 ) {
+                heap_sort( first, last );
+                return;
+            }
+            --depth;
+
+            if( sort_run( first, last ) ) {
+                return;
+            }
+
+            auto parts = simd_partition( first, last, pivot( first, last ) );
+            auto less_last = parts.equal.begin;
+            auto great_first = parts.great.begin;
+
+            // The shorter part is sorted by recursion so the stack stays logarithmic
+            if( less_last - first < last - great_first ) {
+                sort_loop( first, less_last, depth );
+                first = great_first;
+            }
+            else {
+                sort_loop( great_first, last, depth );
+                last = less_last;
+            }
+        }
+
+        insertion_sort( first, last );
+    }
+}
+
+/**
+ * @brief Sorts a random-access range in ascending order of operator <.
+ *
+ * Works in O(n log n), and in O(n) when there are few distinct keys. Not stable.
+ */
+template< typename _RandomAccessIterator >
+void intro_sort( _RandomAccessIterator first, _RandomAccessIterator last )
+{
+    intro_sort_detail::sort_loop( first, last, intro_sort_detail::depth_limit( last - first ) );
+}
+
+/**
+ * @brief Rearranges a random-access range like std::nth_element.
+ *
+ * The element at nth is the one a sorted range would have there, elements before it are not greater
+ * and elements after it are not less. Works in O(n) on average and O(n log n) in the worst case.
+ */
+template< typename _RandomAccessIterator >
+void quick_select( _RandomAccessIterator first, _RandomAccessIterator nth, _RandomAccessIterator last )
+{
+    if( nth == last ) {
+        return;
+    }
+
+    auto depth = intro_sort_detail::depth_limit( last - first );
+    while( last - first > intro_sort_detail::InsertionSortSize ) {
+        if( depth == 0 ) {
+            intro_sort_detail::heap_sort( first, last );
+            return;
+        }
+        --depth;
+
+        auto parts = simd_partition( first, last, intro_sort_detail::pivot( first, last ) );
+        if( nth < parts.equal.begin ) {
+            last = parts.equal.begin;
+        }
+        else if( nth < parts.great.begin ) {
+            return;
+        }
+        else {
+            first = parts.great.begin;
+        }
+    }
+
+    intro_sort_detail::insertion_sort( first, last );
+}
+
+/**
+ * @brief Rearranges a random-access range like std::partial_sort.
+ *
+ * The smallest middle - first elements are sorted into [first, middle), the rest are left in
+ * unspecified order. Works in O(n + k log k) on average for k = middle - first.
+ * Named apart from std::partial_sort, which argument-dependent lookup would find as well.
+ */
+template< typename _RandomAccessIterator >
+void partial_intro_sort( _RandomAccessIterator first, _RandomAccessIterator middle, _RandomAccessIterator last )
+{
+    if( middle == first ) {
+        return;
+    }
+    if( middle != last ) {
+        quick_select( first, middle, last );
+    }
+
+    intro_sort( first, middle );
+}
+
+#endif
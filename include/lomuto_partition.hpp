@@ -1,4 +1,8 @@
+#ifndef LOMUTO_PARTITION_HPP
+#define LOMUTO_PARTITION_HPP
+
 #include <algorithm>
+#include <iterator>
 #include <utility>
 
 #include "partition.hpp"
@@ -25,9 +29,9 @@
 template <typename T, typename _ForwardIterator>
 auto lomuto_partition( _ForwardIterator first, _ForwardIterator last, T pivot ) -> parition_t<_ForwardIterator>
 {
-    typename _ForwardIterator::difference_type less_count = 0;
-    typename _ForwardIterator::difference_type equal_count = 0;
-    typename _ForwardIterator::difference_type great_count = 0;
+    typename std::iterator_traits<_ForwardIterator>::difference_type less_count = 0;
+    typename std::iterator_traits<_ForwardIterator>::difference_type equal_count = 0;
+    typename std::iterator_traits<_ForwardIterator>::difference_type great_count = 0;
     
     auto begin = first;
     auto end = first;
@@ -50,3 +54,5 @@ auto lomuto_partition( _ForwardIterator first, _ForwardIterator last, T pivot )
     
     return {{first, less_count}, {begin, equal_count}, {end, great_count}};
 }
+
+#endif
@@ -0,0 +1,209 @@
+#ifndef MULTIWAY_PARTITION_HPP
+#define MULTIWAY_PARTITION_HPP
+
+#include <cstddef>
+#include <cstdint>
+#include <algorithm>
+#include <iterator>
+#include <memory>
+#include <new>
+#include <type_traits>
+#include <utility>
+#include <vector>
+
+#include "partition.hpp"
+
+// Distribution of a random-access range into k buckets in two passes, following
+// Super Scalar Sample Sort (Sanders, Winkel).
+//
+// The first pass reads every element once. It finds the element's bucket by descending a perfect
+// binary tree of splitters stored level by level, where the comparison result is added to the child
+// index instead of being branched on. The bucket is recorded per element and counted. The second
+// pass copies trivially copyable elements into a buffer, bucket after bucket, and back. Other
+// elements are moved into their buckets in place by following cycles, like American flag sort.
+
+namespace multiway_partition_detail
+{
+    template< typename T >
+    class splitter_tree_t
+    {
+    public:
+        template< typename _ForwardIterator >
+        splitter_tree_t( _ForwardIterator first, _ForwardIterator last )
+        {
+            std::vector<T> sorted( first, last );
+            buckets_ = sorted.size() + 1;
+
+            // Padding with the largest splitter leaves the extra buckets empty
+            while( ( std::size_t( 1 ) << levels_ ) < buckets_ ) {
+                ++levels_;
+            }
+            if( !sorted.empty() ) {
+                sorted.resize( ( std::size_t( 1 ) << levels_ ) - 1, sorted.back() );
+                tree_.assign( sorted.size() + 1, sorted.front() );
+                build( sorted, 0, sorted.size(), 1 );
+            }
+        }
+
+        auto buckets() const -> std::size_t
+        {
+            return buckets_;
+        }
+
+        /**
+         * @brief Returns number of splitters not greater than value.
+         */
+        auto classify( T const & value ) const -> std::size_t
+        {
+            std::size_t node = 1;
+            for( std::size_t level = 0; level < levels_; ++level ) {
+                node = 2 * node + !( value < tree_[ node ] );
+            }
+
+            auto bucket = node - ( std::size_t( 1 ) << levels_ );
+            return bucket < buckets_ ? bucket : buckets_ - 1;
+        }
+
+    private:
+        // Splitters in breadth-first order starting from index 1
+        std::vector<T> tree_;
+        std::size_t levels_ = 0;
+        std::size_t buckets_ = 0;
+
+        void build( std::vector<T> const & sorted, std::size_t begin, std::size_t end, std::size_t node )
+        {
+            if( begin == end ) {
+                return;
+            }
+
+            auto middle = begin + ( end - begin ) / 2;
+            tree_[ node ] = sorted[ middle ];
+            build( sorted, begin, middle, 2 * node );
+            build( sorted, middle + 1, end, 2 * node + 1 );
+        }
+    };
+
+    /**
+     * @brief Copies elements out into their buckets and back.
+     *
+     * Every bucket is written sequentially, so the scattered writes stay in cache. The buffer is
+     * left uninitialized, elements need no default constructor and are constructed once, by copy.
+     */
+    template< typename _RandomAccessIterator, typename Bucket, typename Range >
+    void place( _RandomAccessIterator first, std::vector<Bucket> const & buckets, std::vector<std::size_t> & next,
+               Range const & /*result*/, std::true_type )
+    {
+        using value_t = typename std::iterator_traits<_RandomAccessIterator>::value_type;
+
+        // Trivially copyable elements have trivial destructors, the buffer is only deallocated
+        std::allocator<value_t> allocator;
+        auto size = buckets.size();
+        auto deallocate = [&allocator, size]( value_t * buffer ) { allocator.deallocate( buffer, size ); };
+        std::unique_ptr<value_t, decltype( deallocate )> buffer{ allocator.allocate( size ), deallocate };
+
+        for( std::size_t i = 0; i < size; ++i ) {
+            ::new( static_cast<void *>( buffer.get() + next[ buckets[ i ] ]++ ) ) value_t( first[ i ] );
+        }
+        std::copy( buffer.get(), buffer.get() + size, first );
+    }
+
+    /**
+     * @brief Moves elements into their buckets in place.
+     *
+     * Elements are carried along cycles, each one straight into the next free slot of its bucket.
+     */
+    template< typename _RandomAccessIterator, typename Bucket, typename Range >
+    void place( _RandomAccessIterator first, std::vector<Bucket> & buckets, std::vector<std::size_t> & next,
+               Range const & result, std::false_type )
+    {
+        for( std::size_t bucket = 0; bucket < result.size(); ++bucket ) {
+            auto end = std::size_t( result[ bucket ].begin - first + result[ bucket ].size );
+            while( next[ bucket ] < end ) {
+                auto position = next[ bucket ];
+                auto target = buckets[ position ];
+                if( target != bucket ) {
+                    auto value = std::move( first[ position ] );
+                    do {
+                        auto slot = next[ target ]++;
+                        std::swap( value, first[ slot ] );
+                        std::swap( target, buckets[ slot ] );
+                    } while( target != bucket );
+                    first[ position ] = std::move( value );
+                }
+                ++next[ bucket ];
+            }
+        }
+    }
+
+    template< typename Bucket, typename _RandomAccessIterator, typename T >
+    auto distribute( _RandomAccessIterator first, _RandomAccessIterator last, splitter_tree_t<T> const & tree )
+        -> std::vector<range_t<_RandomAccessIterator>>
+    {
+        using difference_t = typename std::iterator_traits<_RandomAccessIterator>::difference_type;
+
+        auto size = std::size_t( last - first );
+        std::vector<Bucket> buckets( size );
+        std::vector<std::size_t> counts( tree.buckets() );
+
+        // Independent descents of consecutive elements overlap in the pipeline
+        std::size_t i = 0;
+        for( ; i + 4 <= size; i += 4 ) {
+            auto bucket0 = tree.classify( first[ i ] );
+            auto bucket1 = tree.classify( first[ i + 1 ] );
+            auto bucket2 = tree.classify( first[ i + 2 ] );
+            auto bucket3 = tree.classify( first[ i + 3 ] );
+            buckets[ i ] = Bucket( bucket0 );
+            buckets[ i + 1 ] = Bucket( bucket1 );
+            buckets[ i + 2 ] = Bucket( bucket2 );
+            buckets[ i + 3 ] = Bucket( bucket3 );
+            ++counts[ bucket0 ];
+            ++counts[ bucket1 ];
+            ++counts[ bucket2 ];
+            ++counts[ bucket3 ];
+        }
+        for( ; i < size; ++i ) {
+            buckets[ i ] = Bucket( tree.classify( first[ i ] ) );
+            ++counts[ buckets[ i ] ];
+        }
+
+        std::vector<range_t<_RandomAccessIterator>> result( tree.buckets() );
+        std::vector<std::size_t> next( tree.buckets() );
+        std::size_t begin = 0;
+        for( std::size_t bucket = 0; bucket < tree.buckets(); ++bucket ) {
+            result[ bucket ] = { first + difference_t( begin ), difference_t( counts[ bucket ] ) };
+            next[ bucket ] = begin;
+            begin += counts[ bucket ];
+        }
+
+        place( first, buckets, next, result, typename std::is_trivially_copyable<T>::type{} );
+
+        return result;
+    }
+}
+
+/**
+ * @brief Distributes a random-access range into buckets bounded by splitters.
+ *
+ * Bucket i holds the elements not less than splitter i - 1 and less than splitter i, so k splitters
+ * give k + 1 buckets. Works in O(n log k) comparisons and O(n) moves. Needs one byte per element,
+ * four with more than 256 buckets, and a copy of the range for trivially copyable elements.
+ *
+ * @param splitters Container of keys in ascending order.
+ *
+ * @return Range of every bucket in order.
+ */
+template< typename _RandomAccessIterator, typename Splitters >
+auto multiway_partition( _RandomAccessIterator first, _RandomAccessIterator last, Splitters const & splitters )
+    -> std::vector<range_t<_RandomAccessIterator>>
+{
+    using value_t = typename std::iterator_traits<_RandomAccessIterator>::value_type;
+
+    multiway_partition_detail::splitter_tree_t<value_t> tree{ std::begin( splitters ), std::end( splitters ) };
+    if( tree.buckets() <= 256 ) {
+        return multiway_partition_detail::distribute<std::uint8_t>( first, last, tree );
+    }
+
+    return multiway_partition_detail::distribute<std::uint32_t>( first, last, tree );
+}
+
+#endif
@@ -0,0 +1,153 @@
+#ifndef PARALLEL_PARTITION_HPP
+#define PARALLEL_PARTITION_HPP
+
+#include <algorithm>
+#include <cstddef>
+#include <iterator>
+#include <vector>
+
+#include "block_partition.hpp"
+#include "partition.hpp"
+#include "thread_pool.hpp"
+
+// Three-way partition of a random-access range on a thread pool.
+//
+// Like block_partition, the range is split twice: into < pivot and the rest, then the rest into
+// == pivot and > pivot. For each split, every thread first splits its own chunk with block_partition.
+// The sizes of the left parts are then summed into the global boundary. Left elements in front of
+// the boundary and right elements behind it are already in place. The right elements in front of
+// the boundary and the left elements behind it come in equal numbers. They are swapped pairwise,
+// with the swaps spread evenly over the threads.
+
+namespace parallel_partition_detail
+{
+    // Ranges shorter than this per thread are split by one thread
+    static std::size_t const MinChunkSize = 1 << 14;
+
+    template< typename Difference >
+    struct interval_t
+    {
+        Difference begin;
+        Difference end;
+    };
+
+    /**
+     * @brief Finds position of the n-th element of a sequence of intervals.
+     */
+    template< typename Difference >
+    void locate( std::vector<interval_t<Difference>> const & intervals, Difference n, std::size_t & index, Difference & position )
+    {
+        index = 0;
+        while( n >= intervals[ index ].end - intervals[ index ].begin ) {
+            n -= intervals[ index ].end - intervals[ index ].begin;
+            ++index;
+        }
+        position = intervals[ index ].begin + n;
+    }
+
+    /**
+     * @brief Moves elements of the left side before the others.
+     *
+     * @return Iterator past the last element of the left side.
+     */
+    template< typename Side, typename _RandomAccessIterator, typename T >
+    auto split( _RandomAccessIterator first, _RandomAccessIterator last, T const & pivot, thread_pool_t & pool )
+        -> _RandomAccessIterator
+    {
+        using difference_t = typename std::iterator_traits<_RandomAccessIterator>::difference_type;
+        using intervals_t = std::vector<interval_t<difference_t>>;
+
+        auto size = last - first;
+        auto chunks = std::min( pool.size(), std::size_t( size ) / MinChunkSize );
+        if( chunks <= 1 ) {
+            return block_partition_detail::split<Side>( first, last, pivot );
+        }
+
+        std::vector<difference_t> bounds( chunks + 1 );
+        std::vector<difference_t> splits( chunks );
+        for( std::size_t i = 0; i <= chunks; ++i ) {
+            bounds[ i ] = difference_t( size * i / chunks );
+        }
+
+        pool.run( chunks, [&]( std::size_t i ) {
+            splits[ i ] = block_partition_detail::split<Side>( first + bounds[ i ], first + bounds[ i + 1 ], pivot ) - first;
+        } );
+
+        difference_t middle = 0;
+        for( std::size_t i = 0; i < chunks; ++i ) {
+            middle += splits[ i ] - bounds[ i ];
+        }
+
+        // Right elements in front of middle and left elements behind it
+        intervals_t misplaced_right;
+        intervals_t misplaced_left;
+        difference_t misplaced = 0;
+        for( std::size_t i = 0; i < chunks; ++i ) {
+            auto right_end = std::min( bounds[ i + 1 ], middle );
+            if( splits[ i ] < right_end ) {
+                misplaced_right.push_back( { splits[ i ], right_end } );
+                misplaced += right_end - splits[ i ];
+            }
+
+            auto left_begin = std::max( bounds[ i ], middle );
+            if( left_begin < splits[ i ] ) {
+                misplaced_left.push_back( { left_begin, splits[ i ] } );
+            }
+        }
+
+        auto tasks = std::min( chunks, std::size_t( misplaced ) / MinChunkSize + 1 );
+        pool.run( tasks, [&]( std::size_t task ) {
+            auto begin = difference_t( misplaced * task / tasks );
+            auto end = difference_t( misplaced * ( task + 1 ) / tasks );
+            if( begin == end ) {
+                return;
+            }
+
+            std::size_t right_index;
+            std::size_t left_index;
+            difference_t right_position;
+            difference_t left_position;
+            locate( misplaced_right, begin, right_index, right_position );
+            locate( misplaced_left, begin, left_index, left_position );
+
+            while( begin != end ) {
+                auto count = std::min( { end - begin,
+                                         misplaced_right[ right_index ].end - right_position,
+                                         misplaced_left[ left_index ].end - left_position } );
+                std::swap_ranges( first + right_position, first + right_position + count, first + left_position );
+
+                begin += count;
+                right_position += count;
+                left_position += count;
+                if( begin != end && right_position == misplaced_right[ right_index ].end ) {
+                    right_position = misplaced_right[ ++right_index ].begin;
+                }
+                if( begin != end && left_position == misplaced_left[ left_index ].end ) {
+                    left_position = misplaced_left[ ++left_index ].begin;
+                }
+            }
+        } );
+
+        return first + middle;
+    }
+}
+
+/**
+ * @brief Three-way partition of a random-access range using every thread of pool.
+ *
+ * Gives the same parts as block_partition, the order of elements inside each part is unspecified.
+ * Ranges too short to keep the threads busy are partitioned by the calling thread.
+ *
+ * @return Ranges of elements less than, equal to and greater than pivot.
+ */
+template< typename _RandomAccessIterator, typename T >
+auto parallel_partition( _RandomAccessIterator first, _RandomAccessIterator last, T pivot, thread_pool_t & pool )
+    -> parition_t<_RandomAccessIterator>
+{
+    auto equal = parallel_partition_detail::split<block_partition_detail::less_side_t>( first, last, pivot, pool );
+    auto great = parallel_partition_detail::split<block_partition_detail::not_greater_side_t>( equal, last, pivot, pool );
+
+    return {{first, equal - first}, {equal, great - equal}, {great, last - great}};
+}
+
+#endif
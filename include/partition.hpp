@@ -1,11 +1,13 @@
 #ifndef PARTITION_HPP
 #define PARTITION_HPP
 
+#include <iterator>
+
 template <typename _Iterator>
 struct range_t
 {
     _Iterator begin;
-    typename _Iterator::difference_type size;
+    typename std::iterator_traits<_Iterator>::difference_type size;
 };
 
 template <typename _Iterator>
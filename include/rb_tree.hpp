@@ -1,29 +1,95 @@
 #ifndef rb_tree_hpp
 #define rb_tree_hpp
 
+#include <algorithm>
+#include <cstdint>
+#include <fstream>
+#include <functional>
 #include <iostream>
 #include <memory>
-#include <queue>
 #include <sstream>
+#include <type_traits>
+#include <vector>
 
-template< typename T >
-class rb_tree_t
+#include "rb_tree_format.hpp"
+#include "rb_tree_memory.hpp"
+#include "rb_tree_statistics.hpp"
+
+/**
+ * @brief Selects the branch-light descent of rb_tree_t.
+ *
+ * Enabled for arithmetic keys ordered by std::less or std::greater, where a comparison is cheap
+ * and a missed early exit costs less than a mispredicted branch. May be specialized for other types.
+ */
+template< typename T, typename Compare >
+struct rb_tree_branchless_descent : std::integral_constant<bool,
+    std::is_arithmetic<T>::value &&
+    ( std::is_same<Compare, std::less<T>>::value || std::is_same<Compare, std::greater<T>>::value )>
+{
+};
+
+/**
+ * @brief Holds a policy of rb_tree_t, as a base class when the policy is empty so it takes no space.
+ *
+ * get() is const because const lookups update statistics: an empty policy has no state to change
+ * and any other policy is stored mutable.
+ */
+template< typename Policy, int Index, bool = std::is_empty<Policy>::value && !std::is_final<Policy>::value >
+struct rb_tree_policy_t : Policy
+{
+    explicit rb_tree_policy_t( Policy policy = Policy() ) : Policy( std::move( policy ) )
+    {
+    }
+    
+    auto get() const -> Policy &
+    {
+        return const_cast<rb_tree_policy_t &>( *this );
+    }
+};
+
+template< typename Policy, int Index >
+struct rb_tree_policy_t< Policy, Index, false >
+{
+    explicit rb_tree_policy_t( Policy policy = Policy() ) : policy_( std::move( policy ) )
+    {
+    }
+    
+    auto get() const -> Policy &
+    {
+        return policy_;
+    }
+    
+private:
+    mutable Policy policy_;
+};
+
+template< typename T, typename Compare = std::less<T>, typename Statistics = rb_tree_no_statistics_t >
+class rb_tree_t : private rb_tree_policy_t< Compare, 0 >, private rb_tree_policy_t< Statistics, 1 >
 {
 private:
-	enum class color_t {
+	enum class color_t : std::uint8_t {
 		black,
 		red
 	};
 	
+    enum side_t : std::size_t {
+        left,
+        right
+    };
+    
     struct node_t
     {
-        std::shared_ptr<node_t> left = nullptr;
-        std::shared_ptr<node_t> right = nullptr;
+        std::shared_ptr<node_t> child[ 2 ] = { nullptr, nullptr };
         std::shared_ptr<node_t> parent = nullptr;
+        // Number of live nodes in the subtree
         std::size_t count = 1;
         T key;
         color_t color;
-        node_t( T aKey, color_t aColor ) : key{ aKey }, color{ aColor }
+        // Removed lazily, kept only as a placeholder in the shape
+        bool dead = false;
+        // Allocated on its own rather than in a block of nodes
+        bool loose = false;
+        node_t( T aKey, color_t aColor ) : key{ std::move( aKey ) }, color{ aColor }
         {
             
         }
@@ -32,7 +98,7 @@ private:
     /**
      * @brief Returns referense on parent's link.
      *
-     * If node is left child function returns reference on parent->left else returns reference on parent->right.
+     * If node is left child function returns reference on parent->child[ left ] else returns reference on parent->child[ right ].
      *
      * @param node Ponter on node. Pointer must be nonnull.
      *
@@ -41,7 +107,7 @@ private:
     auto & parent_link( std::shared_ptr<node_t> node )
     {
         auto parent = node->parent;
-        return parent->left == node ? parent->left : parent->right;
+        return parent->child[ left ] == node ? parent->child[ left ] : parent->child[ right ];
     }
     
     struct PrintParam
@@ -63,18 +129,74 @@ private:
         std::size_t length;
         PrintType type;
         std::size_t parent_j;
+        // Position of the formatted node in PrintContext::labels
+        std::size_t offset;
+    };
+    
+    struct PrintLabel
+    {
+        std::size_t offset;
+        std::size_t length;
+    };
+    
+    struct PrintContext
+    {
+        std::vector<std::vector<PrintResult>> table;
+        // Every node is formatted once, one after another
+        std::ostringstream labels;
+        std::size_t max_depth;
     };
     
-    static std::size_t length( std::shared_ptr<node_t> node )
+    static PrintLabel label( node_t const * node, PrintContext & context )
     {
-        std::ostringstream stream;
-        stream << node->count << ( node->color == color_t::red ? 'r' : 'b' ) << node->key;
-        return stream.str().size();
+        std::size_t offset = context.labels.tellp();
+        context.labels << node->count << ( node->color == color_t::red ? 'r' : 'b' ) << node->key;
+        return { offset, std::size_t( context.labels.tellp() ) - offset };
     }
+    
+    /**
+     * @brief Line of the rendered tree clipped to width columns.
+     */
+    class PrintLine
+    {
+    public:
+        explicit PrintLine( std::size_t width ) : width_{ width }
+        {
+        }
+        
+        /**
+         * @brief Appends symbol until line reaches column.
+         */
+        void fill( char symbol, std::size_t column )
+        {
+            column = column < width_ ? column : width_;
+            if( text_.size() < column ) {
+                text_.append( column - text_.size(), symbol );
+            }
+        }
+        
+        void append( char const * data, std::size_t length )
+        {
+            auto room = width_ - text_.size();
+            text_.append( data, length < room ? length : room );
+        }
+        
+        void flush( std::ostream & stream )
+        {
+            text_.push_back( '\n' );
+            stream.write( text_.data(), text_.size() );
+            text_.clear();
+        }
         
+    private:
+        std::string text_;
+        std::size_t width_;
+    };
+    
     void
-    static print( std::shared_ptr<node_t> node,
-                  std::vector<std::vector<PrintResult>> & table,
+    static print( node_t const * node,
+                  PrintLabel node_label,
+                  PrintContext & context,
                   std::size_t level,
                   PrintParam & pair,
                   PrintResult & result,
@@ -84,6 +206,7 @@ private:
         static std::size_t const MarginRightChild = 2;
         static std::size_t const MarginNeighbor = 2;
         
+        auto && table = context.table;
         if( table.size() == level ) {
             table.push_back( {} );
         }
@@ -95,67 +218,61 @@ private:
             }
         }
         
-        if( !node->left && !node->right ) {
+        auto visible = level + 1 < context.max_depth;
+        auto left_node = visible ? node->child[ left ].get() : nullptr;
+        auto right_node = visible ? node->child[ right ].get() : nullptr;
+        
+        if( !left_node && !right_node ) {
             result.x = pair.x;
             result.d = pair.d;
-            result.length = length( node );
-            result.type = type;
-            result.parent_j = level == 0 ? 0 : table[ level - 1 ].size();
-            
-            table[ level ].push_back( result );
         }
-        else if ( !node->right ) {
-            if( length( node->left ) + MarginLeftChild > pair.x ) {
-                pair.d += length( node->left ) + MarginLeftChild - pair.x;
+        else if ( !right_node ) {
+            auto left_label = label( left_node, context );
+            if( left_label.length + MarginLeftChild > pair.x ) {
+                pair.d += left_label.length + MarginLeftChild - pair.x;
                 pair.x = 0;
             }
             else {
-                pair.x -= length( node->left ) + MarginLeftChild;
+                pair.x -= left_label.length + MarginLeftChild;
             }
             
-            print( node->left,
-                  table,
+            print( left_node,
+                  left_label,
+                  context,
                   level + 1,
                   pair,
                   result,
                   LeftChild);
             
             result.x += result.length + MarginLeftChild;
-            result.length = length( node );
-            result.type = type;
-            result.parent_j = level == 0 ? 0 : table[ level - 1 ].size();
-            
-            table[ level ].push_back( result );
         }
-        else if ( !node->left ) {
-            pair.x += length( node );
+        else if ( !left_node ) {
+            pair.x += node_label.length;
             pair.x += MarginRightChild;
             
-            print( node->right,
-                  table,
+            print( right_node,
+                  label( right_node, context ),
+                  context,
                   level + 1,
                   pair,
                   result,
                   RightChild );
             
-            result.x -= length( node ) + MarginRightChild;
-            result.length = length( node );
-            result.type = type;
-            result.parent_j = level == 0 ? 0 : table[ level - 1 ].size();
-            
-            table[ level ].push_back( result );
+            result.x -= node_label.length + MarginRightChild;
         }
         else {
-            if( length( node->left ) + MarginLeftChild > pair.x ) {
-                pair.d += length( node->left ) + MarginLeftChild - pair.x;
+            auto left_label = label( left_node, context );
+            if( left_label.length + MarginLeftChild > pair.x ) {
+                pair.d += left_label.length + MarginLeftChild - pair.x;
                 pair.x = 0;
             }
             else {
-                pair.x -= length( node->left ) + MarginLeftChild;
+                pair.x -= left_label.length + MarginLeftChild;
             }
             
-            print( node->left,
-                  table,
+            print( left_node,
+                  left_label,
+                  context,
                   level + 1,
                   pair,
                   result,
@@ -165,128 +282,85 @@ private:
             auto left_length = result.length;
             auto left_d = result.d;
             
-            pair.x = result.x + result.length + MarginLeftChild + length( node ) + MarginRightChild;
+            pair.x = result.x + result.length + MarginLeftChild + node_label.length + MarginRightChild;
             pair.d = result.d;
             
-            print( node->right,
-                  table,
+            print( right_node,
+                  label( right_node, context ),
+                  context,
                   level + 1,
                   pair,
                   result,
                   RightChild );
             
-            result.x = ( left_x + left_length + result.d - left_d + result.x - length( node ) ) / 2;
-            result.length = length( node );
-            result.type = type;
-            result.parent_j = level == 0 ? 0 : table[ level - 1 ].size();
-            
-            table[ level ].push_back( result );
+            result.x = ( left_x + left_length + result.d - left_d + result.x - node_label.length ) / 2;
         }
+        
+        result.length = node_label.length;
+        result.type = type;
+        result.parent_j = level == 0 ? 0 : table[ level - 1 ].size();
+        result.offset = node_label.offset;
+        
+        table[ level ].push_back( result );
     }
     
-    static void print( std::ostream & stream, std::shared_ptr<node_t> node )
+    /**
+     * @brief Lays the tree out, then writes it line by line.
+     *
+     * Each key is formatted once during the layout. Padding is appended in runs
+     * and every line reaches the stream with a single write.
+     */
+    static void print( std::ostream & stream, node_t const * node, std::size_t max_depth, std::size_t max_width )
     {
-        std::vector<std::vector<PrintResult>> table;
+        PrintContext context;
+        context.max_depth = max_depth;
         
-        PrintResult result = {0, 0, 0, Root, 0};
+        PrintResult result = {0, 0, 0, Root, 0, 0};
         PrintParam param = {0, 0};
-        print( node, table, 0, param, result, Root );
+        print( node, label( node, context ), context, 0, param, result, Root );
         
-        std::queue<std::shared_ptr<node_t>> queue;
-        queue.push( node );
+        auto && table = context.table;
+        auto labels = context.labels.str();
+        PrintLine line{ max_width };
         
         for( std::size_t i = 0; i < table.size(); ++i ) {
-            auto printed_symbols = 0;
-            
             if( i != 0 ) {
                 for( std::size_t j = 0; j < table[ i ].size(); ++j ) {
                     auto && pair = table[ i ][ j ];
+                    auto && parent_pair = table[ i - 1 ][ pair.parent_j ];
                     if( pair.type == LeftChild ) {
-                        auto offset = pair.x + result.d - pair.d + pair.length - printed_symbols + 1;
-                        for( std::size_t k = 0; k < offset; ++k ) {
-                            stream << ' ';
-                        }
-                        printed_symbols += offset;
-                        
-                        auto parent_pair = table[ i - 1 ][ pair.parent_j ];
-                        
-                        auto count =  parent_pair.x + result.d - parent_pair.d - printed_symbols - 1;
-                        for( auto i = 0; i < count; ++i ) {
-                            stream << '_';
-                        }
-                        printed_symbols += count;
-                        
-                        stream << '/';
-                        printed_symbols += 1;
+                        line.fill( ' ', pair.x + result.d - pair.d + pair.length + 1 );
+                        line.fill( '_', parent_pair.x + result.d - parent_pair.d - 1 );
+                        line.append( "/", 1 );
                     }
                     else if( pair.type == RightChild ) {
-                        
-                        auto parent_pair = table[ i - 1 ][ pair.parent_j ];
-                        auto count =  parent_pair.x + result.d - parent_pair.d + parent_pair.length - printed_symbols;
-                        for( auto i = 0; i < count; ++i ) {
-                            stream << ' ';
-                        }
-                        printed_symbols += count;
-                        
-                        stream << '\\';
-                        printed_symbols += 1;
-                        
-                        count =  pair.x + result.d - pair.d - 1 - printed_symbols;
-                        for( auto i = 0; i < count; ++i ) {
-                            stream << '_';
-                        }
-                        printed_symbols += count;
+                        line.fill( ' ', parent_pair.x + result.d - parent_pair.d + parent_pair.length );
+                        line.append( "\\", 1 );
+                        line.fill( '_', pair.x + result.d - pair.d - 1 );
                     }
                 }
-                stream << '\n';
-                printed_symbols = 0;
+                line.flush( stream );
                 
                 for( std::size_t j = 0; j < table[ i ].size(); ++j ) {
                     auto && pair = table[ i ][ j ];
                     if( pair.type == LeftChild ) {
-                        auto offset = pair.x + result.d - pair.d + pair.length - printed_symbols;
-                        for( std::size_t k = 0; k < offset; ++k ) {
-                            stream << ' ';
-                        }
-                        printed_symbols += offset;
-                        stream << '/';
-                        printed_symbols += 1;
+                        line.fill( ' ', pair.x + result.d - pair.d + pair.length );
+                        line.append( "/", 1 );
                     }
                     else if ( pair.type == RightChild ) {
-                        auto offset = pair.x + result.d - pair.d - printed_symbols - 1;
-                        for( std::size_t k = 0; k < offset; ++k ) {
-                            stream << ' ';
-                        }
-                        printed_symbols += offset;
-                        stream << '\\';
-                        printed_symbols += 1;
+                        line.fill( ' ', pair.x + result.d - pair.d - 1 );
+                        line.append( "\\", 1 );
                     }
                 }
-                stream << '\n';
+                line.flush( stream );
             }
             
-            printed_symbols = 0;
-            
             for( std::size_t j = 0; j < table[ i ].size(); ++j ) {
-                auto node = queue.front();
-                queue.pop();
-                if( node->left ) {
-                    queue.push( node->left );
-                }
-                if( node->right ) {
-                    queue.push( node->right );
-                }
-                
                 auto && pair = table[ i ][ j ];
-                auto offset = pair.x + result.d - pair.d - printed_symbols;
-                for( std::size_t k = 0; k < offset; ++k ) {
-                    stream << ' ';
-                }
-                
-                stream << node->count << ( node->color == color_t::red ? 'r' : 'b' ) << node->key;
-                printed_symbols += offset + pair.length;
+                line.fill( ' ', pair.x + result.d - pair.d );
+                line.append( labels.data() + pair.offset, pair.length );
             }
-            stream << '\n';
+            line.flush( stream );
         }
         
         stream << std::endl;
@@ -295,12 +369,115 @@ private:
     std::shared_ptr<node_t> root_ = nullptr;
     std::size_t size_ = 0;
     
-    static color_t color( std::shared_ptr<node_t> node )
+    // Comparator and statistics policy are base classes, so empty policies add nothing to the tree
+    auto compare() const -> Compare &
+    {
+        return rb_tree_policy_t< Compare, 0 >::get();
+    }
+    
+    auto counters() const -> Statistics &
+    {
+        return rb_tree_policy_t< Statistics, 1 >::get();
+    }
+    
+    bool less( T const & lhs, T const & rhs ) const
+    {
+        counters().comparison();
+        return compare()( lhs, rhs );
+    }
+    
+    // State of an incremental compaction. Inserts and removes keep it, nodes inserted behind
+    // the cursor stay outside the block until the next pass.
+    std::shared_ptr<std::vector<node_t>> compact_block_ = nullptr;
+    std::shared_ptr<node_t> compact_next_ = nullptr;
+    
+    // Shared by trees created with clone() while they still share nodes, created with the tree
+    // so that clone() only copies it.
+    std::shared_ptr<void> owners_ = std::make_shared<char>();
+    
+    auto shared() const -> bool
+    {
+        return owners_.use_count() > 1;
+    }
+    
+    struct lazy_remove_t
+    {
+        bool enabled = false;
+        double max_fraction = 0;
+        std::size_t budget = 0;
+    };
+    
+    // Settings of lazy removal, number of nodes marked as removed and state of an incremental purge.
+    lazy_remove_t lazy_;
+    std::size_t tombstones_ = 0;
+    std::shared_ptr<node_t> purge_next_ = nullptr;
+    
+    // Memory accounting: nodes allocated one by one, blocks the nodes were relocated into,
+    // and heap memory owned by keys of all nodes.
+    std::size_t loose_nodes_ = 0;
+    mutable std::vector<std::weak_ptr<std::vector<node_t>>> blocks_;
+    std::size_t key_bytes_ = 0;
+    std::size_t memory_budget_ = std::size_t( -1 );
+    
+    static auto key_bytes( T const & key ) -> std::size_t
+    {
+        return rb_tree_key_memory<T>::heap_bytes( key );
+    }
+    
+    static auto key_bytes( node_t const * node ) -> std::size_t
+    {
+        std::size_t result = 0;
+        if( rb_tree_key_memory<T>::owns_heap ) {
+            for( ; node; node = node->child[ right ].get() ) {
+                result += key_bytes( node->key ) + key_bytes( node->child[ left ].get() );
+            }
+        }
+        
+        return result;
+    }
+    
+    auto make_node( T key ) -> std::shared_ptr<node_t>
+    {
+        auto node = std::make_shared<node_t>( std::move( key ), color_t::red );
+        counters().allocation();
+        node->loose = true;
+        ++loose_nodes_;
+        key_bytes_ += key_bytes( node->key );
+        
+        return node;
+    }
+    
+    /**
+     * @brief Accounts for a node unlinked from the tree.
+     */
+    void release( node_t const * node )
+    {
+        loose_nodes_ -= node->loose;
+        key_bytes_ -= key_bytes( node->key );
+    }
+    
+    /**
+     * @brief Registers a new block of nodes, forgetting blocks already freed.
+     */
+    void adopt( std::shared_ptr<std::vector<node_t>> const & block ) const
+    {
+        blocks_.erase( std::remove_if( blocks_.begin(), blocks_.end(), []( std::weak_ptr<std::vector<node_t>> const & block ) {
+            return block.expired();
+        } ), blocks_.end() );
+        blocks_.push_back( block );
+    }
+    
+    auto within_budget() const -> bool
+    {
+        return memory_budget_ == std::size_t( -1 ) || memory_usage().total() <= memory_budget_;
+    }
+    
+    static color_t color( std::shared_ptr<node_t> const & node )
     {
         return node ? node->color : color_t::black;
     }
     
-    static void color( std::shared_ptr<node_t> node, color_t color )
+    static void color( std::shared_ptr<node_t> const & node, color_t color )
     {
         if( node ) {
             node->color = color;
@@ -310,432 +487,1891 @@ private:
     void insertFixUp( std::shared_ptr<node_t> node )
     {
         for( auto dad = node->parent; is_red( dad ) ; dad = node->parent ) {
+            counters().insert_fix_up_iteration();
             auto granddad = dad->parent;
-            if( dad == granddad->left ) {
-                auto uncle = granddad->right;
-                if( is_red( uncle ) ) {
-                    black( dad );
-                    black( uncle );
-                    red( granddad );
+            auto side = side_t( dad == granddad->child[ right ] );
+            auto uncle = granddad->child[ !side ];
+            if( is_red( uncle ) ) {
+                black( dad );
+                black( uncle );
+                red( granddad );
                 
-                    node = granddad;
-                }
-                else {
-                    if( node == dad->right ) {
-                        left_rotate( dad );
-                        std::swap( node, dad );
-                    }
-                    black( dad );
-                    red( granddad );
-                    right_rotate( granddad );
-                }
+                node = granddad;
             }
             else {
-                auto uncle = granddad->left;
-                if( is_red( uncle ) ) {
-                    black( dad );
-                    black( uncle );
-                    red( granddad );
-                    
-                    node = granddad;
-                }
-                else {
-                    if( node == dad->left ) {
-                        right_rotate( dad );
-                        std::swap( node, dad );
-                    }
-                    black( dad );
-                    red( granddad );
-                    left_rotate( granddad );
+                if( node == dad->child[ !side ] ) {
+                    rotate( dad, side );
+                    std::swap( node, dad );
                 }
+                black( dad );
+                red( granddad );
+                rotate( granddad, side_t( !side ) );
             }
         }
         
         black( root_ );
     }
     
-    // x->right != nil
-    void left_rotate( std::shared_ptr<node_t> x )
+    /**
+     * @brief Rotates x down to the given side.
+     *
+     * rotate( x, left ) is the left rotation, rotate( x, right ) is the right one.
+     * Counts of ancestors do not change, so only x and its new parent are recounted.
+     *
+     * @param x Ponter on node. x->child[ !side ] must be nonnull.
+     */
+    void rotate( std::shared_ptr<node_t> x, side_t side )
     {
-        auto y = x->right;
-        x->right = y->left;
-        if( y->left ) {
-            y->left->parent = x;
-        }
+        counters().rotation( side == left );
         
-        y->parent = x->parent;
-        if( !x->parent ) {
-            root_ = y;
-        }
-        else if( x == x->parent->left ) {
-            x->parent->left = y;
-        }
-        else {
-            x->parent->right = y;
+        auto & link = owner( x.get() );
+        auto y = std::move( x->child[ !side ] );
+        x->child[ !side ] = std::move( y->child[ side ] );
+        if( x->child[ !side ] ) {
+            x->child[ !side ]->parent = x;
         }
         
-        left_link( y, x );
+        // link owns x until y takes its place
+        y->parent = std::move( x->parent );
+        x->parent = y;
+        y->child[ side ] = std::move( link );
+        link = std::move( y );
+        
+        recount( x );
+        recount( link );
     }
     
-    static void recount( std::shared_ptr<node_t> node )
+    static void recount( node_t * node )
     {
-        std::size_t count = 1;
-        if( node->left ) {
-            count += node->left->count;
+        std::size_t count = !node->dead;
+        if( node->child[ left ] ) {
+            count += node->child[ left ]->count;
         }
-        if( node->right ) {
-            count += node->right->count;
+        if( node->child[ right ] ) {
+            count += node->child[ right ]->count;
         }
         
         node->count = count;
     }
     
-    // y->left != nil
-    void right_rotate( std::shared_ptr<node_t> y )
+    static void recount( std::shared_ptr<node_t> const & node )
     {
-        auto x = y->left;
-        y->left = x->right;
-        if( x->right ) {
-            x->right->parent = y;
-        }
-        
-        x->parent = y->parent;
-        if( !y->parent ) {
-            root_ = x;
-        }
-        else if( y == y->parent->left ) {
-            y->parent->left = x;
-        }
-        else {
-            y->parent->right = x;
-        }
-        
-        right_link( x, y );
+        recount( node.get() );
     }
     
     // oldnode != nil
-    void transplant( std::shared_ptr<node_t> old_node, std::shared_ptr<node_t> new_node )
+    void transplant( std::shared_ptr<node_t> const & old_node, std::shared_ptr<node_t> const & new_node )
     {
         if( !old_node->parent ) {
             root_ = new_node;
         }
-        else if ( old_node->parent->left == old_node ) {
-            old_node->parent->left = new_node;
+        else if ( old_node->parent->child[ left ] == old_node ) {
+            old_node->parent->child[ left ] = new_node;
         }
         else {
-            old_node->parent->right = new_node;
+            old_node->parent->child[ right ] = new_node;
         }
         
+        auto parent = std::move( old_node->parent );
         if( new_node ) {
-            new_node->parent = old_node->parent;
+            new_node->parent = parent;
         }
         
-        old_node->parent = nullptr;
-        
-        for( auto it = new_node; it; it = it->parent ) {
+        std::size_t length = 0;
+        for( auto it = new_node ? new_node.get() : parent.get(); it; it = it->parent.get() ) {
             recount( it );
+            ++length;
         }
+        counters().recount_walk( length );
     }
     
     
-    auto minimum( std::shared_ptr<node_t> node )
+    static auto minimum( std::shared_ptr<node_t> const & node ) -> std::shared_ptr<node_t> const &
     {
-        while( node->left ) {
-            node = node->left;
+        auto result = &node;
+        while( ( *result )->child[ left ] ) {
+            result = &( *result )->child[ left ];
         }
         
-        return node;
+        return *result;
     }
     
-    static void black( std::shared_ptr<node_t> node )
+    static auto successor( std::shared_ptr<node_t> node ) -> std::shared_ptr<node_t>
     {
-        if( node ) {
-            node->color = color_t::black;
+        if( node->child[ right ] ) {
+            node = node->child[ right ];
+            while( node->child[ left ] ) {
+                node = node->child[ left ];
+            }
+            
+            return node;
         }
-    }
-    
-    static void red( std::shared_ptr<node_t> node )
-    {
-        if( node ) {
-            node->color = color_t::red;
+        
+        auto parent = node->parent;
+        while( parent && node == parent->child[ right ] ) {
+            node = parent;
+            parent = parent->parent;
         }
+        
+        return parent;
     }
     
-    static bool is_black( std::shared_ptr<node_t> node )
-    {
-        return color( node ) == color_t::black;
-    }
-    
-    static bool is_red( std::shared_ptr<node_t> node )
+    /**
+     * @brief Moves the cursor of an incremental compaction past a node about to be unlinked.
+     */
+    void unlinking( node_t const * node )
     {
-        return color( node ) == color_t::red;
+        if( compact_next_.get() == node ) {
+            compact_next_ = successor( compact_next_ );
+        }
     }
     
-    // node != nullptr
-    void removeFixUp( std::shared_ptr<node_t> node )
+    /**
+     * @brief Returns the in-order neighbour of node on the given side, nullptr at the end.
+     */
+    static auto neighbour( node_t * node, side_t side ) -> node_t *
     {
-        while( node != root_ && is_black( node ) ) {
-            auto p = node->parent;
-            if( node == p->left ) {
-                auto s = p->right;
-                if( is_red( s ) ) {
-                    black( s );
-                    red( p );
-                    left_rotate( p );
-                    s = p->right;
-                }
-                if( is_black( s->left ) && is_black( s->right ) ) {
-                    red( s );
-                    node = p;
-                }
-                else {
-                    if( is_red( s->left ) ) {
-                        black( s->left );
-                        red( s );
-                        right_rotate( s );
-                        s = p->right;
-                    }
-                    
-                    color( s, color( p ) );
-                    black( p );
-                    black( s->right );
-                    left_rotate( p );
-                    node = root_;
-                }
-            }
-            else {
-                auto s = p->left;
-                if( is_red( s ) ) {
-                    black( s );
-                    red( p );
-                    right_rotate( p );
-                    s = p->left;
-                }
-                    
-                if( is_black( s->right ) && is_black( s->left ) ) {
-                    red( s );
-                    node = p;
-                }
-                else {
-                    if( is_red( s->right ) ) {
-                        black( s->right );
-                        red( s );
-                        left_rotate( s );
-                        s = p->left;
-                    }
-                    
-                    color( s, color( p ) );
-                    black( p );
-                    black( s->left );
-                    right_rotate( p );
-                    node = root_;
-                }
+        if( node->child[ side ] ) {
+            node = node->child[ side ].get();
+            while( node->child[ !side ] ) {
+                node = node->child[ !side ].get();
             }
+            
+            return node;
         }
         
-        black( node );
-    }
-    
-    static void left_link( std::shared_ptr<node_t> parent, std::shared_ptr<node_t> node )
-    {
-        parent->left = node;
-        node->parent = parent;
-        
-        recount( node );
-        recount( parent );
-    }
-    
-    static void right_link( std::shared_ptr<node_t> parent, std::shared_ptr<node_t> node )
-    {
-        parent->right = node;
-        node->parent = parent;
-        
-        for( auto it = parent; it; it = it->parent ) {
-            recount( it );
+        auto parent = node->parent.get();
+        while( parent && node == parent->child[ side ].get() ) {
+            node = parent;
+            parent = parent->parent.get();
         }
+        
+        return parent;
     }
     
     /**
-     * Remove node from tree
+     * @brief Moves node into the next slot of block.
+     *
+     * Key, color and count are kept and all links pointing on node are rewired to the copy.
      *
      * @param node Ponter on node. Pointer must be nonnull.
+     * @param block Storage with free capacity.
+     *
+     * @return Pointer on the relocated node.
      */
-    void remove( std::shared_ptr<node_t> node )
+    auto relocate( std::shared_ptr<node_t> node, std::shared_ptr<std::vector<node_t>> const & block ) -> std::shared_ptr<node_t>
     {
-        auto originalColor = color( node );
-        std::shared_ptr<node_t> x = nullptr; // узел в котором может нарушиться свойство красно-черного дерева
-        if( !node->left ) {
-            x = node->right;
-            transplant( node, node->right );
+        key_bytes_ -= key_bytes( node->key );
+        block->emplace_back( std::move( node->key ), node->color );
+        std::shared_ptr<node_t> copy{ block, &block->back() };
+        key_bytes_ += key_bytes( copy->key );
+        
+        copy->count = node->count;
+        copy->dead = node->dead;
+        loose_nodes_ -= node->loose;
+        copy->child[ left ] = std::move( node->child[ left ] );
+        copy->child[ right ] = std::move( node->child[ right ] );
+        copy->parent = std::move( node->parent );
+        
+        if( !copy->parent ) {
+            root_ = copy;
         }
-        else if( !node->right ) {
-            x = node->left;
-            transplant( node, node->left );
+        else if( copy->parent->child[ left ] == node ) {
+            copy->parent->child[ left ] = copy;
         }
         else {
-            auto m = minimum( node->right );
-            originalColor = color( m );
-            x = m->right;
-            if( m->parent != node ) {
-                transplant( m, m->right );
-                right_link( m, node->right );
-            }
-            
-            transplant( node, m );
-            left_link( m, node->left );
-            color( m, node->color );
+            copy->parent->child[ right ] = copy;
         }
         
-        if( x && originalColor == color_t::black ) {
-            removeFixUp( x );
+        if( copy->child[ left ] ) {
+            copy->child[ left ]->parent = copy;
+        }
+        if( copy->child[ right ] ) {
+            copy->child[ right ]->parent = copy;
         }
         
-        --size_;
+        return copy;
     }
     
-    auto find( T key ) -> std::shared_ptr<node_t>
+    template< typename F >
+    static void for_each( node_t const * node, F & f )
     {
-        auto node = root_;
         while( node ) {
-            if( node->key == key ) {
-                break;
-            }
-            else if ( key < node->key ) {
-                node = node->left;
-            }
-            else {
-                node = node->right;
+            for_each( node->child[ left ].get(), f );
+            if( !node->dead ) {
+                f( node->key );
             }
+            node = node->child[ right ].get();
         }
-        
-        return node;
     }
     
-    static std::size_t count( std::shared_ptr<node_t> node )
+    struct image_reader_t
     {
-        return node ? node->count : 0;
-    }
+        std::ifstream shape;
+        std::ifstream keys;
+        rb_tree_checksum_t shape_checksum;
+        rb_tree_checksum_t keys_checksum;
+        bool has_shape;
+        // Depth colored red when the tree is rebuilt balanced
+        std::size_t red_depth;
+        // Depth no red-black tree of the stored size reaches
+        std::size_t max_depth;
+        bool good;
+    };
     
-public:
-    void insert( T key );
-    void remove( T key );
-    void print( std::ostream & stream ) const;
-    auto size() const -> std::size_t;
-    auto representation() const -> std::string;
-    void representation( std::shared_ptr<node_t> node, std::ostringstream & stream ) const
+    static void save_shape( std::ostream & stream, node_t const * node, rb_tree_checksum_t & checksum )
     {
-        if( node->left ) {
-            representation( node->left, stream );
-        }
-        
-        stream << ( node->color == color_t::red ? "r" : "b" );
-        stream << node->key;
-        
-        if( node->right ) {
-            representation( node->right, stream );
+        while( node ) {
+            std::uint64_t record = std::uint64_t{ count( node->child[ left ] ) } << 1 | ( node->color == color_t::red );
+            checksum.update( &record, sizeof( record ) );
+            stream.write( reinterpret_cast<char const *>( &record ), sizeof( record ) );
+            
+            save_shape( stream, node->child[ left ].get(), checksum );
+            node = node->child[ right ].get();
         }
     }
     
-    static std::shared_ptr<node_t> select( std::size_t n, std::shared_ptr<node_t> node )
+    /**
+     * @brief Rebuilds a subtree of count nodes from the image into block in in-order sequence.
+     *
+     * @return Pointer on the root of the subtree, nullptr if count is 0 or the image is broken.
+     */
+    static auto load_subtree( image_reader_t & reader, std::size_t count, std::size_t depth,
+                              std::shared_ptr<std::vector<node_t>> const & block ) -> std::shared_ptr<node_t>
     {
-        if( !node ) {
+        if( count == 0 || !reader.good ) {
+            return nullptr;
+        }
+        if( depth >= reader.max_depth ) {
+            reader.good = false;
             return nullptr;
         }
         
-        auto rank = count( node->left ) + 1;
-        if( rank == n ) {
-            return node;
+        std::size_t left_count = ( count - 1 ) / 2;
+        auto red = depth == reader.red_depth;
+        if( reader.has_shape ) {
+            std::uint64_t record;
+            if( !reader.shape.read( reinterpret_cast<char *>( &record ), sizeof( record ) ) || record >> 1 >= count ) {
+                reader.good = false;
+                return nullptr;
+            }
+            reader.shape_checksum.update( &record, sizeof( record ) );
+            left_count = record >> 1;
+            red = record & 1;
+        }
+        
+        auto left_node = load_subtree( reader, left_count, depth + 1, block );
+        
+        T key{};
+        if( !reader.good || !rb_tree_key_io<T>::read( reader.keys, key, reader.keys_checksum ) ) {
+            reader.good = false;
+            return nullptr;
         }
-        else if( n < rank ) {
-            return select( n, node->left );
+        block->emplace_back( std::move( key ), red ? color_t::red : color_t::black );
+        std::shared_ptr<node_t> result{ block, &block->back() };
+        result->count = count;
+        
+        if( left_node ) {
+            result->child[ left ] = std::move( left_node );
+            result->child[ left ]->parent = result;
         }
-        else {
-            return select( n - rank, node->right );
+        
+        auto right_node = load_subtree( reader, count - left_count - 1, depth + 1, block );
+        if( right_node ) {
+            result->child[ right ] = std::move( right_node );
+            result->child[ right ]->parent = result;
         }
+        
+        return result;
     }
     
-    std::shared_ptr<T> select( std::size_t n ) const
-    {
-        if( n != 0 && n <= size_ ) {
+    /**
+     * @brief Returns depth of the red level of a perfectly balanced tree of size nodes.
+     *
+     * A balanced tree is perfect when size + 1 is a power of two, otherwise its deepest level is red.
+     */
+    static auto red_depth( std::size_t size ) -> std::size_t
+    {
+        if( ( size & ( size + 1 ) ) == 0 ) {
+            return std::size_t( -1 );
+        }
+        
+        std::size_t depth = 0;
+        for( ; size > 1; size >>= 1 ) {
+            ++depth;
+        }
+        
+        return depth;
+    }
+    
+    /**
+     * @brief Builds a perfectly balanced subtree of count keys into block in in-order sequence.
+     *
+     * @param keys Next key in ascending order, advanced past the keys of the subtree.
+     */
+    static auto build( T const * & keys, std::size_t count, std::size_t depth, std::size_t red_depth,
+                       std::shared_ptr<std::vector<node_t>> const & block ) -> std::shared_ptr<node_t>
+    {
+        if( count == 0 ) {
+            return nullptr;
+        }
+        
+        std::size_t left_count = ( count - 1 ) / 2;
+        auto left_node = build( keys, left_count, depth + 1, red_depth, block );
+        
+        block->emplace_back( *keys++, depth == red_depth ? color_t::red : color_t::black );
+        std::shared_ptr<node_t> result{ block, &block->back() };
+        result->count = count;
+        
+        if( left_node ) {
+            result->child[ left ] = std::move( left_node );
+            result->child[ left ]->parent = result;
+        }
+        
+        auto right_node = build( keys, count - left_count - 1, depth + 1, red_depth, block );
+        if( right_node ) {
+            result->child[ right ] = std::move( right_node );
+            result->child[ right ]->parent = result;
+        }
+        
+        return result;
+    }
+    
+    /**
+     * @brief Copies subtree into block in in-order sequence.
+     *
+     * @param node Ponter on node. Pointer must be nonnull.
+     * @param block Storage with enough free capacity for the whole subtree.
+     *
+     * @return Pointer on the copy of node.
+     */
+    static auto copy( node_t const * node, std::shared_ptr<std::vector<node_t>> const & block ) -> std::shared_ptr<node_t>
+    {
+        std::shared_ptr<node_t> left_copy = node->child[ left ] ? copy( node->child[ left ].get(), block ) : nullptr;
+        
+        block->emplace_back( node->key, node->color );
+        std::shared_ptr<node_t> result{ block, &block->back() };
+        result->count = node->count;
+        result->dead = node->dead;
+        
+        if( left_copy ) {
+            result->child[ left ] = std::move( left_copy );
+            result->child[ left ]->parent = result;
+        }
+        if( node->child[ right ] ) {
+            result->child[ right ] = copy( node->child[ right ].get(), block );
+            result->child[ right ]->parent = result;
+        }
+        
+        return result;
+    }
+    
+    /**
+     * @brief Gives the tree its own nodes if they are shared with a clone.
+     */
+    void detach()
+    {
+        if( !shared() ) {
+            return;
+        }
+        
+        loose_nodes_ = 0;
+        blocks_.clear();
+        if( root_ ) {
+            auto block = std::make_shared<std::vector<node_t>>();
+            block->reserve( size_ + tombstones_ );
+            counters().allocation();
+            root_ = copy( root_.get(), block );
+            adopt( block );
+        }
+        // Copied keys may hold less heap memory than the originals
+        key_bytes_ = key_bytes( root_.get() );
+        
+        compact_block_ = nullptr;
+        compact_next_ = nullptr;
+        purge_next_ = nullptr;
+        owners_ = std::make_shared<char>();
+    }
+    
+    /**
+     * @brief Returns the link owning node: root_ or a child link of its parent.
+     *
+     * @param node Ponter on node. Pointer must be nonnull.
+     */
+    auto owner( node_t * node ) -> std::shared_ptr<node_t> &
+    {
+        auto parent = node->parent.get();
+        return parent ? parent->child[ parent->child[ right ].get() == node ] : root_;
+    }
+    
+    static bool is_red( node_t const * node )
+    {
+        return node && node->color == color_t::red;
+    }
+    
+    static bool is_black( node_t const * node )
+    {
+        return !is_red( node );
+    }
+    
+    static void red( node_t * node )
+    {
+        node->color = color_t::red;
+    }
+    
+    static void black( node_t * node )
+    {
+        node->color = color_t::black;
+    }
+    
+    static void black( std::shared_ptr<node_t> const & node )
+    {
+        if( node ) {
+            node->color = color_t::black;
+        }
+    }
+    
+    static void red( std::shared_ptr<node_t> const & node )
+    {
+        if( node ) {
+            node->color = color_t::red;
+        }
+    }
+    
+    static bool is_black( std::shared_ptr<node_t> const & node )
+    {
+        return color( node ) == color_t::black;
+    }
+    
+    static bool is_red( std::shared_ptr<node_t> const & node )
+    {
+        return color( node ) == color_t::red;
+    }
+    
+    // node may be nullptr, parent is parent of node
+    void removeFixUp( std::shared_ptr<node_t> node, std::shared_ptr<node_t> parent )
+    {
+        while( node != root_ && is_black( node ) ) {
+            counters().remove_fix_up_iteration();
+            auto p = parent;
+            auto side = side_t( node != p->child[ left ] );
+            auto s = p->child[ !side ];
+            if( is_red( s ) ) {
+                black( s );
+                red( p );
+                rotate( p, side );
+                s = p->child[ !side ];
+            }
+            
+            if( is_black( s->child[ left ] ) && is_black( s->child[ right ] ) ) {
+                red( s );
+                node = p;
+                parent = p->parent;
+            }
+            else {
+                if( is_red( s->child[ side ] ) ) {
+                    black( s->child[ side ] );
+                    red( s );
+                    rotate( s, side_t( !side ) );
+                    s = p->child[ !side ];
+                }
+                
+                color( s, color( p ) );
+                black( p );
+                black( s->child[ !side ] );
+                rotate( p, side );
+                node = root_;
+            }
+        }
+        
+        black( node );
+    }
+    
+    static void left_link( std::shared_ptr<node_t> const & parent, std::shared_ptr<node_t> const & node )
+    {
+        parent->child[ left ] = node;
+        node->parent = parent;
+        
+        recount( node );
+        recount( parent );
+    }
+    
+    void right_link( std::shared_ptr<node_t> const & parent, std::shared_ptr<node_t> const & node )
+    {
+        parent->child[ right ] = node;
+        node->parent = parent;
+        
+        recount( node );
+        std::size_t length = 0;
+        for( auto it = parent.get(); it; it = it->parent.get() ) {
+            recount( it );
+            ++length;
+        }
+        counters().recount_walk( length );
+    }
+    
+    /**
+     * Remove node from tree
+     *
+     * @param node Ponter on node. Pointer must be nonnull.
+     */
+    void remove( std::shared_ptr<node_t> node )
+    {
+        unlinking( node.get() );
+        
+        auto originalColor = color( node );
+        std::shared_ptr<node_t> x = nullptr; // узел в котором может нарушиться свойство красно-черного дерева
+        std::shared_ptr<node_t> x_parent = node->parent;
+        if( !node->child[ left ] ) {
+            x = node->child[ right ];
+            transplant( node, node->child[ right ] );
+        }
+        else if( !node->child[ right ] ) {
+            x = node->child[ left ];
+            transplant( node, node->child[ left ] );
+        }
+        else {
+            auto m = minimum( node->child[ right ] );
+            originalColor = color( m );
+            x = m->child[ right ];
+            x_parent = m;
+            if( m->parent != node ) {
+                x_parent = m->parent;
+                transplant( m, m->child[ right ] );
+                right_link( m, node->child[ right ] );
+            }
+            
+            left_link( m, node->child[ left ] );
+            transplant( node, m );
+            color( m, node->color );
+        }
+        
+        if( originalColor == color_t::black ) {
+            removeFixUp( x, x_parent );
+        }
+        
+        node->child[ left ] = nullptr;
+        node->child[ right ] = nullptr;
+    }
+    
+    /**
+     * @brief Links a detached node as a new leaf and rebalances.
+     *
+     * @param new_node Ponter on red node without links and with count 1.
+     */
+    void attach( std::shared_ptr<node_t> new_node )
+    {
+        counters().descent();
+        
+        node_t * parent = nullptr;
+        auto side = left;
+        for( auto node = root_.get(); node; node = node->child[ side ].get() ) {
+            parent = node;
+            ++node->count;
+            side = side_t( !less( new_node->key, node->key ) );
+        }
+        if( !parent ) {
+            root_ = new_node;
+        }
+        else {
+            new_node->parent = owner( parent );
+            parent->child[ side ] = new_node;
+        }
+        
+        insertFixUp( std::move( new_node ) );
+        ++size_;
+    }
+    
+    // One comparison per level: the lowest node not less than key is tracked down to a leaf.
+    auto lookup( T const & key, std::true_type ) const -> node_t *
+    {
+        counters().descent();
+        node_t * candidate = nullptr;
+        for( auto node = root_.get(); node; ) {
+            auto side = side_t( less( node->key, key ) );
+            candidate = side ? candidate : node;
+            node = node->child[ side ].get();
+        }
+        
+        return candidate && !less( key, candidate->key ) ? candidate : nullptr;
+    }
+    
+    auto lookup( T const & key, std::false_type ) const -> node_t *
+    {
+        counters().descent();
+        auto node = root_.get();
+        while( node ) {
+            if( less( key, node->key ) ) {
+                node = node->child[ left ].get();
+            }
+            else if( less( node->key, key ) ) {
+                node = node->child[ right ].get();
+            }
+            else {
+                break;
+            }
+        }
+        
+        return node;
+    }
+    
+    // First live node equal to key: duplicates of a tombstone may follow it in order.
+    auto lookup_live( T const & key ) const -> node_t *
+    {
+        counters().descent();
+        node_t * node = nullptr;
+        for( auto it = root_.get(); it; ) {
+            if( less( it->key, key ) ) {
+                it = it->child[ right ].get();
+            }
+            else {
+                node = it;
+                it = it->child[ left ].get();
+            }
+        }
+        
+        while( node && node->dead && !less( key, node->key ) ) {
+            node = neighbour( node, right );
+        }
+        
+        return node && !node->dead && !less( key, node->key ) ? node : nullptr;
+    }
+    
+    /**
+     * @brief Advances a descent of find_many by one level.
+     *
+     * Follows lookup(): the branch-light step only tracks the lowest node not less than key,
+     * the other one stops at an equal node. The key is found if candidate is not greater than it.
+     *
+     * @return Child to visit next, nullptr when the descent is over.
+     */
+    auto find_step( T const & key, node_t const * node, node_t const * & candidate, std::true_type ) const -> node_t const *
+    {
+        auto side = side_t( less( node->key, key ) );
+        candidate = side ? candidate : node;
+        return node->child[ side ].get();
+    }
+    
+    auto find_step( T const & key, node_t const * node, node_t const * & candidate, std::false_type ) const -> node_t const *
+    {
+        if( less( key, node->key ) ) {
+            return node->child[ left ].get();
+        }
+        if( less( node->key, key ) ) {
+            return node->child[ right ].get();
+        }
+        
+        candidate = node;
+        return nullptr;
+    }
+    
+    auto search( T const & key ) const -> node_t *
+    {
+        return tombstones_ ? lookup_live( key ) : lookup( key, rb_tree_branchless_descent<T, Compare>{} );
+    }
+    
+    auto find( T const & key ) -> std::shared_ptr<node_t>
+    {
+        auto node = search( key );
+        if( !node ) {
+            return nullptr;
+        }
+        if( !node->parent ) {
+            return root_;
+        }
+        
+        return node->parent->child[ node->parent->child[ right ].get() == node ];
+    }
+    
+    static std::size_t count( std::shared_ptr<node_t> const & node )
+    {
+        return node ? node->count : 0;
+    }
+    
+    /**
+     * @brief Turns node into a tombstone, purges tombstones once there are too many.
+     *
+     * @param node Ponter on live node.
+     */
+    void bury( node_t * node )
+    {
+        node->dead = true;
+        std::size_t length = 0;
+        for( ; node; node = node->parent.get() ) {
+            --node->count;
+            ++length;
+        }
+        counters().recount_walk( length );
+        
+        --size_;
+        ++tombstones_;
+        if( double( tombstones_ ) > lazy_.max_fraction * double( size_ + tombstones_ ) ) {
+            if( lazy_.budget != 0 ) {
+                purge( lazy_.budget );
+            }
+            else {
+                purge();
+            }
+        }
+    }
+    
+    /**
+     * Number of descents interleaved by find_many.
+     */
+    static std::size_t const FindGroupSize = 8;
+    
+    static void prefetch( node_t const * node )
+    {
+#if defined(__GNUC__)
+        __builtin_prefetch( node );
+#else
+        (void)node;
+#endif
+    }
+    
+public:
+    rb_tree_t() = default;
+    explicit rb_tree_t( Compare compare );
+    rb_tree_t( rb_tree_t const & other );
+    rb_tree_t( rb_tree_t && other );
+    ~rb_tree_t();
+    
+    auto operator =( rb_tree_t const & other ) -> rb_tree_t &;
+    auto operator =( rb_tree_t && other ) -> rb_tree_t &;
+    
+    void swap( rb_tree_t & other );
+    
+    /**
+     * @brief Removes all keys.
+     *
+     * Links are cut one node at a time, so neither parent cycles nor deep recursion are left behind.
+     */
+    void clear();
+    
+    /**
+     * @brief Returns a copy which shares nodes with this tree.
+     *
+     * Works in O(1). The first mutation of either tree copies its nodes in O(n).
+     * Several threads may clone one tree at once.
+     */
+    auto clone() const -> rb_tree_t;
+    
+    /**
+     * @return false if the tree exceeds its memory budget after the insertion, the key is inserted anyway.
+     */
+    bool insert( T key );
+    void remove( T key );
+    
+    /**
+     * @brief Same as remove( old_key ) followed by insert( new_key ), without allocation.
+     *
+     * When new_key fits between the neighbours of old_key it overwrites the key in place.
+     * Otherwise the node of old_key is unlinked and linked again at the position of new_key.
+     */
+    void replace( T const & old_key, T new_key );
+    
+    /**
+     * @brief Inserts key rebalancing on the way down.
+     *
+     * Red-red violations are resolved by color flips and rotations above the current node,
+     * so every node of the path is visited once and counts are updated during the descent.
+     * The path is never climbed: parent links are maintained for the rest of the tree
+     * and only read to find the link owning a rotated node.
+     */
+    bool insert_top_down( T key );
+    
+    /**
+     * @brief Removes key pushing a red node down the path.
+     *
+     * The node physically unlinked is the last one of the path, its key replaces the found one.
+     * A read-only lookup runs first so counts are only decremented when key is present.
+     */
+    void remove_top_down( T const & key );
+    
+    /**
+     * @brief Makes remove() turn nodes into tombstones instead of unlinking them.
+     *
+     * A tombstone keeps its place in the shape and is skipped by every query. Removing a key only
+     * decrements the counts on the path of its node, without rotations. remove_top_down() then
+     * behaves like remove(). Once tombstones exceed max_fraction of all nodes, remove() purges them.
+     *
+     * @param max_fraction Share of tombstones among all nodes tolerated, in [0, 1).
+     * @param budget Maximum number of nodes visited by the purge of one remove(),
+     * 0 rebuilds the tree at once.
+     */
+    void lazy_remove( double max_fraction, std::size_t budget = 0 );
+    
+    /**
+     * @brief Purges all tombstones and makes remove() unlink nodes again.
+     */
+    void eager_remove();
+    auto tombstones() const -> std::size_t;
+    
+    /**
+     * @brief Unlinks tombstones met among nodes visited in ascending order.
+     *
+     * The visit continues where the previous call stopped, so a purge can be spread over
+     * several calls with a bounded pause.
+     *
+     * @param budget Maximum number of nodes visited by this call.
+     *
+     * @return true if no tombstones are left.
+     */
+    bool purge( std::size_t budget );
+    
+    /**
+     * @brief Rebuilds the tree perfectly balanced from its live keys in O(n).
+     */
+    void purge();
+    
+    /**
+     * @brief Returns bytes held by the tree.
+     *
+     * Works in O(number of node blocks). Blocks stay allocated while any of their nodes is alive,
+     * nodes shared with clones are counted by every tree sharing them. Allocator headers are estimated.
+     */
+    auto memory_usage() const -> rb_tree_memory_t;
+    
+    /**
+     * @brief Sets bytes of memory_usage().total() above which insert() reports failure.
+     *
+     * @param bytes Budget, std::size_t( -1 ) for none, which is the default.
+     */
+    void memory_budget( std::size_t bytes );
+    auto memory_budget() const -> std::size_t;
+    bool contains( T const & key ) const;
+    
+    /**
+     * @brief Returns number of keys less than key.
+     *
+     * Works in O(log n) using subtree counts, select( rank( key ) + 1 ) is the first key not less than key.
+     */
+    auto rank( T const & key ) const -> std::size_t;
+    
+    /**
+     * @brief Draws the tree, every node as its count, color and key.
+     *
+     * @param max_depth Number of levels drawn, deeper nodes are left out.
+     * @param max_width Number of columns drawn, longer lines are cut.
+     */
+    void print( std::ostream & stream,
+                std::size_t max_depth = std::size_t( -1 ),
+                std::size_t max_width = std::size_t( -1 ) ) const;
+    
+    /**
+     * @brief Writes the tree in Graphviz DOT format in one preorder pass.
+     *
+     * @param max_depth Number of levels written, deeper nodes are left out.
+     */
+    void dot( std::ostream & stream, std::size_t max_depth = std::size_t( -1 ) ) const;
+    auto size() const -> std::size_t;
+    
+    /**
+     * @brief Returns counters of the Statistics policy.
+     *
+     * Lookups update the counters too, see rb_tree_statistics_t for concurrent readers.
+     */
+    auto statistics() const -> Statistics const &;
+    
+    /**
+     * @brief Returns height, black height and depth histogram of the tree in O(n).
+     */
+    auto stats() const -> rb_tree_stats_t<Statistics>;
+    
+    /**
+     * @brief Writes a versioned, checksummed binary image of the tree.
+     *
+     * Keys are written in order, see rb_tree_format.hpp for the layout.
+     *
+     * @param path File to write.
+     * @param shape Also write colors and subtree sizes so load() restores the exact tree.
+     *
+     * @return true on success.
+     */
+    bool save( std::string const & path, bool shape = true ) const;
+    
+    /**
+     * @brief Replaces content of the tree with an image written by save().
+     *
+     * Streams the image in O(n) into one block of nodes without comparisons or rebalancing.
+     * Images without shape are rebuilt perfectly balanced. The tree is unchanged on failure.
+     *
+     * @return true on success.
+     */
+    bool load( std::string const & path );
+    
+    /**
+     * @brief Looks up a sequence of keys.
+     *
+     * Keys are processed in groups of FindGroupSize descents which advance in lockstep.
+     * Every child is prefetched before it is visited so cache misses of the group overlap.
+     *
+     * @param first, last Range of keys.
+     * @param out Receives true or false for each key in the order of the range.
+     *
+     * @return Iterator past the last written result.
+     */
+    template< typename _ForwardIterator, typename _OutputIterator >
+    auto find_many( _ForwardIterator first, _ForwardIterator last, _OutputIterator out ) const -> _OutputIterator;
+    
+    /**
+     * @brief Calls f for every key in ascending order.
+     */
+    template< typename F >
+    void for_each( F f ) const
+    {
+        for_each( root_.get(), f );
+    }
+    
+    /**
+     * @brief Relocates nodes into one contiguous block in in-order sequence.
+     *
+     * Shape, colors and counts are kept. Nodes are rewired one at a time so the tree stays valid
+     * between calls and compaction can be spread over several calls with a bounded pause.
+     * Inserts and removes between calls keep the progress: nodes inserted behind the cursor stay
+     * outside the block, and nodes inserted ahead of it may overflow into a further, smaller block.
+     *
+     * @param budget Maximum number of nodes relocated by this call.
+     *
+     * @return true if the pass is complete, false if it needs more calls.
+     */
+    bool compact( std::size_t budget );
+    void compact();
+    auto representation() const -> std::string;
+    void representation( std::shared_ptr<node_t> node, std::ostringstream & stream ) const
+    {
+        if( node->child[ left ] ) {
+            representation( node->child[ left ], stream );
+        }
+        
+        stream << ( node->color == color_t::red ? "r" : "b" );
+        stream << node->key;
+        
+        if( node->child[ right ] ) {
+            representation( node->child[ right ], stream );
+        }
+    }
+    
+    static std::shared_ptr<node_t> select( std::size_t n, std::shared_ptr<node_t> node )
+    {
+        if( !node ) {
+            return nullptr;
+        }
+        
+        auto before = count( node->child[ left ] );
+        if( n <= before ) {
+            return select( n, node->child[ left ] );
+        }
+        else if( !node->dead && n == before + 1 ) {
+            return node;
+        }
+        else {
+            return select( n - before - !node->dead, node->child[ right ] );
+        }
+    }
+    
+    /**
+     * @brief Copies the n-th key in ascending order, counting from 1, without allocation.
+     *
+     * @return false if n is out of range, key is left unchanged then.
+     */
+    bool select( std::size_t n, T & key ) const
+    {
+        if( n == 0 || n > size_ ) {
+            return false;
+        }
+        
+        auto node = root_.get();
+        for( ;; ) {
+            auto before = count( node->child[ left ] );
+            if( n <= before ) {
+                node = node->child[ left ].get();
+            }
+            else if( !node->dead && n == before + 1 ) {
+                key = node->key;
+                return true;
+            }
+            else {
+                n -= before + !node->dead;
+                node = node->child[ right ].get();
+            }
+        }
+    }
+    
+    std::shared_ptr<T> select( std::size_t n ) const
+    {
+        if( n != 0 && n <= size_ ) {
             auto result = select( n, root_ );
             if( result ) {
                 return std::make_shared<T>( result->key );
             }
         }
-        
-        return nullptr;
+        
+        return nullptr;
+    }
+};
+
+
+//template< typename T >
+//auto
+//rb_tree_t<T>::select( std::size_t n ) const -> std::shared_ptr<T>
+//{
+//
+//}
+
+template< typename T, typename Compare, typename Statistics >
+auto & operator <<( std::ostream & stream, rb_tree_t< T, Compare, Statistics > const & tree )
+{
+    tree.print( stream );
+    
+    return stream;
+}
+
+template< typename T, typename Compare, typename Statistics >
+rb_tree_t< T, Compare, Statistics >::rb_tree_t( Compare compare ) : rb_tree_policy_t< Compare, 0 >{ compare }
+{
+}
+
+template< typename T, typename Compare, typename Statistics >
+rb_tree_t< T, Compare, Statistics >::rb_tree_t( rb_tree_t const & other )
+    : rb_tree_policy_t< Compare, 0 >{ other.compare() }, rb_tree_policy_t< Statistics, 1 >{},
+      size_{ other.size_ }, lazy_{ other.lazy_ }, tombstones_{ other.tombstones_ },
+      memory_budget_{ other.memory_budget_ }
+{
+    if( other.root_ ) {
+        auto block = std::make_shared<std::vector<node_t>>();
+        block->reserve( size_ + tombstones_ );
+        counters().allocation();
+        root_ = copy( other.root_.get(), block );
+        adopt( block );
+        key_bytes_ = key_bytes( root_.get() );
+    }
+}
+
+template< typename T, typename Compare, typename Statistics >
+rb_tree_t< T, Compare, Statistics >::rb_tree_t( rb_tree_t && other )
+{
+    swap( other );
+}
+
+template< typename T, typename Compare, typename Statistics >
+rb_tree_t< T, Compare, Statistics >::~rb_tree_t()
+{
+    clear();
+}
+
+template< typename T, typename Compare, typename Statistics >
+auto rb_tree_t< T, Compare, Statistics >::operator =( rb_tree_t const & other ) -> rb_tree_t &
+{
+    if( this != &other ) {
+        rb_tree_t copy{ other };
+        swap( copy );
+    }
+    
+    return *this;
+}
+
+template< typename T, typename Compare, typename Statistics >
+auto rb_tree_t< T, Compare, Statistics >::operator =( rb_tree_t && other ) -> rb_tree_t &
+{
+    if( this != &other ) {
+        clear();
+        swap( other );
+    }
+    
+    return *this;
+}
+
+template< typename T, typename Compare, typename Statistics >
+void
+rb_tree_t< T, Compare, Statistics >::swap( rb_tree_t & other )
+{
+    std::swap( root_, other.root_ );
+    std::swap( size_, other.size_ );
+    std::swap( compare(), other.compare() );
+    std::swap( counters(), other.counters() );
+    std::swap( compact_block_, other.compact_block_ );
+    std::swap( compact_next_, other.compact_next_ );
+    std::swap( owners_, other.owners_ );
+    std::swap( lazy_, other.lazy_ );
+    std::swap( tombstones_, other.tombstones_ );
+    std::swap( purge_next_, other.purge_next_ );
+    std::swap( loose_nodes_, other.loose_nodes_ );
+    std::swap( blocks_, other.blocks_ );
+    std::swap( key_bytes_, other.key_bytes_ );
+    std::swap( memory_budget_, other.memory_budget_ );
+}
+
+template< typename T, typename Compare, typename Statistics >
+void
+rb_tree_t< T, Compare, Statistics >::clear()
+{
+    compact_block_ = nullptr;
+    compact_next_ = nullptr;
+    purge_next_ = nullptr;
+    size_ = 0;
+    tombstones_ = 0;
+    loose_nodes_ = 0;
+    blocks_.clear();
+    key_bytes_ = 0;
+    
+    auto node = std::move( root_ );
+    if( shared() ) {
+        owners_ = std::make_shared<char>();
+        return;
+    }
+    
+    while( node ) {
+        if( node->child[ left ] ) {
+            node = node->child[ left ];
+        }
+        else if( node->child[ right ] ) {
+            node = node->child[ right ];
+        }
+        else {
+            auto parent = std::move( node->parent );
+            if( parent ) {
+                ( parent->child[ left ] == node ? parent->child[ left ] : parent->child[ right ] ) = nullptr;
+            }
+            node = std::move( parent );
+        }
     }
-};
+}
 
+template< typename T, typename Compare, typename Statistics >
+auto rb_tree_t< T, Compare, Statistics >::clone() const -> rb_tree_t
+{
+    rb_tree_t result{ compare() };
+    result.root_ = root_;
+    result.size_ = size_;
+    result.owners_ = owners_;
+    result.lazy_ = lazy_;
+    result.tombstones_ = tombstones_;
+    result.loose_nodes_ = loose_nodes_;
+    result.blocks_ = blocks_;
+    result.key_bytes_ = key_bytes_;
+    result.memory_budget_ = memory_budget_;
+    
+    return result;
+}
 
-//template< typename T >
-//auto
-//rb_tree_t<T>::select( std::size_t n ) const -> std::shared_ptr<T>
-//{
-//
-//}
+template< typename T, typename Compare, typename Statistics >
+void
+rb_tree_t< T, Compare, Statistics >::print( std::ostream & stream, std::size_t max_depth, std::size_t max_width ) const
+{
+    if( root_ && max_depth != 0 ) {
+        print( stream, root_.get(), max_depth, max_width );
+    }
+}
 
-template< typename T >
-auto & operator <<( std::ostream & stream, rb_tree_t< T > const & tree )
+template< typename T, typename Compare, typename Statistics >
+void
+rb_tree_t< T, Compare, Statistics >::dot( std::ostream & stream, std::size_t max_depth ) const
 {
-    tree.print( stream );
+    struct entry_t
+    {
+        node_t const * node;
+        std::size_t id;
+        std::size_t depth;
+    };
     
-    return stream;
+    stream << "digraph rb_tree {\n"
+              "    node [shape=circle, style=filled, fontcolor=white];\n";
+    
+    // Keys are formatted into one reusable buffer, then escaped into the label
+    std::ostringstream key;
+    std::string label;
+    std::vector<entry_t> stack;
+    std::size_t ids = 0;
+    if( root_ && max_depth != 0 ) {
+        stack.push_back( { root_.get(), ids++, 0 } );
+    }
+    
+    while( !stack.empty() ) {
+        auto entry = stack.back();
+        stack.pop_back();
+        auto node = entry.node;
+        
+        key.str( "" );
+        key << node->key;
+        label.clear();
+        for( auto symbol : key.str() ) {
+            if( symbol == '"' || symbol == '\\' ) {
+                label.push_back( '\\' );
+            }
+            label.push_back( symbol );
+        }
+        
+        stream << "    n" << entry.id << " [label=\"" << label << "\", xlabel=\"" << node->count
+               << "\", fillcolor=" << ( node->color == color_t::red ? "red" : "black" ) << "];\n";
+        
+        if( entry.depth + 1 >= max_depth || ( !node->child[ left ] && !node->child[ right ] ) ) {
+            continue;
+        }
+        
+        // A missing child is drawn invisible so the other one keeps its side
+        std::size_t child_ids[ 2 ];
+        for( auto side : { left, right } ) {
+            child_ids[ side ] = ids++;
+            if( !node->child[ side ] ) {
+                stream << "    n" << child_ids[ side ] << " [style=invis];\n";
+            }
+            stream << "    n" << entry.id << " -> n" << child_ids[ side ]
+                   << ( node->child[ side ] ? ";\n" : " [style=invis];\n" );
+        }
+        
+        for( auto side : { right, left } ) {
+            if( node->child[ side ] ) {
+                stack.push_back( { node->child[ side ].get(), child_ids[ side ], entry.depth + 1 } );
+            }
+        }
+    }
+    
+    stream << "}\n";
+}
+
+template< typename T, typename Compare, typename Statistics >
+bool
+rb_tree_t< T, Compare, Statistics >::insert( T key )
+{
+    detach();
+    
+    attach( make_node( std::move( key ) ) );
+    
+    return within_budget();
 }
 
-template< typename T >
+template< typename T, typename Compare, typename Statistics >
 void
-rb_tree_t<T>::print( std::ostream & stream ) const
+rb_tree_t< T, Compare, Statistics >::remove( T key )
 {
-    if( root_ ) {
-        print( stream, root_ );
+    if( lazy_.enabled ) {
+        auto found = search( key );
+        if( found && shared() ) {
+            detach();
+            found = search( key );
+        }
+        if( found ) {
+            bury( found );
+        }
+        return;
+    }
+    
+    auto node = find( key );
+    if( node && shared() ) {
+        detach();
+        node = find( key );
+    }
+    
+    if( !node ) {
+        return;
     }
+    
+    release( node.get() );
+    remove( node );
+    --size_;
 }
 
-template< typename T >
+template< typename T, typename Compare, typename Statistics >
 void
-rb_tree_t< T >::insert( T key )
+rb_tree_t< T, Compare, Statistics >::replace( T const & old_key, T new_key )
 {
-    auto new_node = std::make_shared<node_t>( key, color_t::red );
+    detach();
     
-    std::shared_ptr<node_t> parent;
-    auto node = root_;
-    while( node ) {
+    auto found = search( old_key );
+    if( !found ) {
+        attach( make_node( std::move( new_key ) ) );
+        return;
+    }
+    
+    // Neighbours still bound new_key, so the order holds with the key overwritten
+    auto prev = neighbour( found, left );
+    auto next = neighbour( found, right );
+    // The assigned key may keep the buffer of the old one
+    key_bytes_ -= key_bytes( found->key );
+    if( ( !prev || !less( new_key, prev->key ) ) && ( !next || !less( next->key, new_key ) ) ) {
+        found->key = std::move( new_key );
+        key_bytes_ += key_bytes( found->key );
+        return;
+    }
+    
+    auto node = owner( found );
+    remove( node );
+    --size_;
+    node->key = std::move( new_key );
+    key_bytes_ += key_bytes( node->key );
+    node->count = 1;
+    node->color = color_t::red;
+    attach( std::move( node ) );
+}
+
+template< typename T, typename Compare, typename Statistics >
+bool
+rb_tree_t< T, Compare, Statistics >::insert_top_down( T key )
+{
+    detach();
+    
+    auto new_node = make_node( std::move( key ) );
+    counters().descent();
+    auto const & new_key = new_node->key;
+    ++size_;
+    
+    node_t * grandparent = nullptr;
+    node_t * parent = nullptr;
+    auto node = root_.get();
+    auto side = right;
+    auto last = right;
+    for( ;; ) {
+        auto inserted = !node;
+        if( inserted ) {
+            node = new_node.get();
+            if( parent ) {
+                node->parent = owner( parent );
+                parent->child[ side ] = std::move( new_node );
+            }
+            else {
+                root_ = std::move( new_node );
+            }
+        }
+        else {
+            ++node->count;
+            if( is_red( node->child[ left ].get() ) && is_red( node->child[ right ].get() ) ) {
+                red( node );
+                black( node->child[ left ].get() );
+                black( node->child[ right ].get() );
+            }
+        }
+        
+        if( is_red( node ) && is_red( parent ) ) {
+            if( node == parent->child[ last ].get() ) {
+                rotate( owner( grandparent ), side_t( !last ) );
+                black( parent );
+            }
+            else {
+                rotate( owner( parent ), last );
+                rotate( owner( grandparent ), side_t( !last ) );
+                black( node );
+                if( !inserted ) {
+                    ++node->count;
+                }
+            }
+            red( grandparent );
+        }
+        
+        if( inserted ) {
+            break;
+        }
+        
+        last = side;
+        side = side_t( !less( new_key, node->key ) );
+        grandparent = parent;
         parent = node;
-        node = key < node->key ? node->left : node->right;
+        node = node->child[ side ].get();
+    }
+    
+    black( root_ );
+    
+    return within_budget();
+}
+
+template< typename T, typename Compare, typename Statistics >
+void
+rb_tree_t< T, Compare, Statistics >::remove_top_down( T const & key )
+{
+    if( lazy_.enabled ) {
+        remove( key );
+        return;
+    }
+    if( !lookup( key, rb_tree_branchless_descent<T, Compare>{} ) ) {
+        return;
     }
-    if( !parent ) {
-        root_ = new_node;
+    
+    detach();
+    
+    counters().descent();
+    node_t * found = nullptr;
+    node_t * parent = nullptr;
+    node_t * node = nullptr;
+    auto next = root_.get();
+    auto side = right;
+    while( next ) {
+        auto last = side;
+        parent = node;
+        node = next;
+        --node->count;
+        
+        side = side_t( less( node->key, key ) );
+        if( !side && !less( key, node->key ) ) {
+            found = node;
+        }
+        
+        if( is_black( node ) && is_black( node->child[ side ].get() ) ) {
+            if( is_red( node->child[ !side ].get() ) ) {
+                rotate( owner( node ), side );
+                red( node );
+                parent = node->parent.get();
+                black( parent );
+                
+                --node->count;
+                --parent->count;
+            }
+            else if( parent && parent->child[ !last ] ) {
+                auto sibling = parent->child[ !last ].get();
+                if( is_black( sibling->child[ left ].get() ) && is_black( sibling->child[ right ].get() ) ) {
+                    black( parent );
+                    red( sibling );
+                    red( node );
+                }
+                else {
+                    if( is_red( sibling->child[ last ].get() ) ) {
+                        rotate( owner( sibling ), side_t( !last ) );
+                    }
+                    rotate( owner( parent ), last );
+                    
+                    auto top = parent->parent.get();
+                    red( node );
+                    red( top );
+                    black( top->child[ left ].get() );
+                    black( top->child[ right ].get() );
+                }
+            }
+        }
+        
+        next = node->child[ side ].get();
     }
-    else if ( key < parent->key ) {
-        left_link( parent, new_node );
+    
+    key_bytes_ -= key_bytes( found->key );
+    loose_nodes_ -= node->loose;
+    if( found != node ) {
+        key_bytes_ -= key_bytes( node->key );
+        found->key = std::move( node->key );
+        key_bytes_ += key_bytes( found->key );
     }
-    else {
-        right_link( parent, new_node );
+    
+    unlinking( node );
+    auto & link = owner( node );
+    auto removed = std::move( link );
+    link = std::move( node->child[ node->child[ left ] ? left : right ] );
+    if( link ) {
+        link->parent = std::move( removed->parent );
     }
     
-    insertFixUp( new_node );
-    ++size_;
+    removed->parent = nullptr;
+    removed->child[ left ] = nullptr;
+    removed->child[ right ] = nullptr;
+    
+    black( root_ );
+    --size_;
 }
 
-template< typename T >
+template< typename T, typename Compare, typename Statistics >
 void
-rb_tree_t< T >::remove( T key )
+rb_tree_t< T, Compare, Statistics >::lazy_remove( double max_fraction, std::size_t budget )
 {
-    auto node = find( key );
-    if( node ) {
-        remove( node );
+    lazy_.enabled = true;
+    lazy_.max_fraction = max_fraction;
+    lazy_.budget = budget;
+}
+
+template< typename T, typename Compare, typename Statistics >
+void
+rb_tree_t< T, Compare, Statistics >::eager_remove()
+{
+    if( tombstones_ ) {
+        purge();
+    }
+    
+    lazy_ = lazy_remove_t{};
+}
+
+template< typename T, typename Compare, typename Statistics >
+auto rb_tree_t< T, Compare, Statistics >::tombstones() const -> std::size_t
+{
+    return tombstones_;
+}
+
+template< typename T, typename Compare, typename Statistics >
+bool
+rb_tree_t< T, Compare, Statistics >::purge( std::size_t budget )
+{
+    if( !tombstones_ ) {
+        return true;
+    }
+    
+    detach();
+    
+    if( !purge_next_ ) {
+        purge_next_ = minimum( root_ );
+    }
+    
+    for( ; purge_next_ && budget != 0; --budget ) {
+        auto node = std::move( purge_next_ );
+        purge_next_ = successor( node );
+        if( node->dead ) {
+            release( node.get() );
+            remove( node );
+            --tombstones_;
+        }
+    }
+    
+    if( !tombstones_ ) {
+        purge_next_ = nullptr;
+    }
+    
+    return !tombstones_;
+}
+
+template< typename T, typename Compare, typename Statistics >
+void
+rb_tree_t< T, Compare, Statistics >::purge()
+{
+    std::vector<T> keys;
+    keys.reserve( size_ );
+    for_each( [&]( T const & key ) { keys.push_back( key ); } );
+    
+    rb_tree_t result{ compare() };
+    auto block = std::make_shared<std::vector<node_t>>();
+    block->reserve( keys.size() );
+    counters().allocation();
+    
+    auto next = static_cast<T const *>( keys.data() );
+    result.root_ = build( next, keys.size(), 0, red_depth( keys.size() ), block );
+    result.size_ = keys.size();
+    result.lazy_ = lazy_;
+    result.memory_budget_ = memory_budget_;
+    result.key_bytes_ = key_bytes( result.root_.get() );
+    result.adopt( block );
+    
+    swap( result );
+    std::swap( counters(), result.counters() );
+}
+
+template< typename T, typename Compare, typename Statistics >
+auto rb_tree_t< T, Compare, Statistics >::memory_usage() const -> rb_tree_memory_t
+{
+    rb_tree_memory_t result;
+    result.nodes = loose_nodes_ * sizeof( node_t );
+    result.overhead = loose_nodes_ * ( rb_tree_allocation_size( rb_tree_control_block_size + sizeof( node_t ) ) - sizeof( node_t ) );
+    result.keys = key_bytes_;
+    
+    for( auto && weak : blocks_ ) {
+        if( auto block = weak.lock() ) {
+            auto bytes = block->capacity() * sizeof( node_t );
+            result.nodes += bytes;
+            result.overhead += rb_tree_allocation_size( bytes ) - bytes +
+                               rb_tree_allocation_size( rb_tree_control_block_size + sizeof( *block ) );
+        }
+    }
+    
+    return result;
+}
+
+template< typename T, typename Compare, typename Statistics >
+void
+rb_tree_t< T, Compare, Statistics >::memory_budget( std::size_t bytes )
+{
+    memory_budget_ = bytes;
+}
+
+template< typename T, typename Compare, typename Statistics >
+auto rb_tree_t< T, Compare, Statistics >::memory_budget() const -> std::size_t
+{
+    return memory_budget_;
+}
+
+template< typename T, typename Compare, typename Statistics >
+bool
+rb_tree_t< T, Compare, Statistics >::contains( T const & key ) const
+{
+    return search( key ) != nullptr;
+}
+
+template< typename T, typename Compare, typename Statistics >
+auto rb_tree_t< T, Compare, Statistics >::rank( T const & key ) const -> std::size_t
+{
+    counters().descent();
+    std::size_t result = 0;
+    for( auto node = root_.get(); node; ) {
+        if( less( node->key, key ) ) {
+            result += count( node->child[ left ] ) + !node->dead;
+            node = node->child[ right ].get();
+        }
+        else {
+            node = node->child[ left ].get();
+        }
     }
+    
+    return result;
 }
 
-template< typename T >
-auto rb_tree_t< T >::size() const -> std::size_t
+template< typename T, typename Compare, typename Statistics >
+auto rb_tree_t< T, Compare, Statistics >::size() const -> std::size_t
 {
     return size_;
 }
 
-template< typename T >
-auto rb_tree_t< T >::representation() const -> std::string
+template< typename T, typename Compare, typename Statistics >
+bool
+rb_tree_t< T, Compare, Statistics >::save( std::string const & path, bool shape ) const
+{
+    // Tombstones have no place in an image, the shape would not match the keys
+    shape = shape && tombstones_ == 0;
+    std::ofstream stream{ path, std::ios::binary | std::ios::trunc };
+    
+    rb_tree_file_header_t header;
+    std::memset( &header, 0, sizeof( header ) );
+    header.stamp();
+    header.flags = ( shape ? rb_tree_file_shape : 0u ) | ( rb_tree_key_io<T>::trivial ? rb_tree_file_trivial_keys : 0u );
+    header.size = size_;
+    header.key_size = rb_tree_key_io<T>::trivial ? sizeof( T ) : 0;
+    header.key_align = rb_tree_key_io<T>::trivial ? alignof( T ) : 1;
+    header.compare_id = rb_tree_compare_id<Compare>::value;
+    stream.write( reinterpret_cast<char const *>( &header ), sizeof( header ) );
+    
+    rb_tree_checksum_t shape_checksum;
+    if( shape ) {
+        header.shape_offset = sizeof( header );
+        save_shape( stream, root_.get(), shape_checksum );
+    }
+    header.shape_checksum = shape_checksum.value();
+    
+    std::uint64_t offset = sizeof( header ) + ( shape ? size_ * sizeof( std::uint64_t ) : 0 );
+    std::uint64_t align = header.key_align < 8 ? 8 : header.key_align;
+    for( ; offset % align != 0; ++offset ) {
+        stream.put( 0 );
+    }
+    header.keys_offset = offset;
+    
+    rb_tree_checksum_t keys_checksum;
+    for_each( [&]( T const & key ) {
+        rb_tree_key_io<T>::write( stream, key, keys_checksum );
+    } );
+    header.keys_checksum = keys_checksum.value();
+    
+    stream.seekp( 0 );
+    stream.write( reinterpret_cast<char const *>( &header ), sizeof( header ) );
+    stream.flush();
+    
+    return static_cast<bool>( stream );
+}
+
+template< typename T, typename Compare, typename Statistics >
+bool
+rb_tree_t< T, Compare, Statistics >::load( std::string const & path )
+{
+    image_reader_t reader;
+    reader.keys.open( path, std::ios::binary | std::ios::ate );
+    std::uint64_t length = reader.keys.tellg();
+    reader.keys.seekg( 0 );
+    
+    rb_tree_file_header_t header;
+    if( !reader.keys.read( reinterpret_cast<char *>( &header ), sizeof( header ) ) || !header.valid() ) {
+        return false;
+    }
+    if( header.keys_offset > length ) {
+        return false;
+    }
+    
+    auto trivial = ( header.flags & rb_tree_file_trivial_keys ) != 0;
+    if( trivial != rb_tree_key_io<T>::trivial || header.key_size != ( trivial ? sizeof( T ) : 0 ) ||
+        header.compare_id != rb_tree_compare_id<Compare>::value ) {
+        return false;
+    }
+    
+    // A corrupted size must not reserve more nodes than the file holds keys and shape records
+    reader.has_shape = ( header.flags & rb_tree_file_shape ) != 0;
+    auto min_size = std::max<std::uint64_t>( rb_tree_key_io<T>::min_size, 1 );
+    if( header.size > ( length - header.keys_offset ) / min_size ||
+        ( reader.has_shape && ( header.shape_offset > header.keys_offset ||
+                                header.size > ( header.keys_offset - header.shape_offset ) / sizeof( std::uint64_t ) ) ) ) {
+        return false;
+    }
+    if( reader.has_shape ) {
+        reader.shape.open( path, std::ios::binary );
+        reader.shape.seekg( header.shape_offset );
+    }
+    reader.keys.seekg( header.keys_offset );
+    
+    reader.red_depth = red_depth( header.size );
+    // Height of a red-black tree is at most 2 log2( size + 1 )
+    reader.max_depth = 0;
+    for( auto size = header.size + 1; size > 1; size >>= 1 ) {
+        reader.max_depth += 2;
+    }
+    reader.max_depth += 2;
+    reader.good = true;
+    
+    rb_tree_t result{ compare() };
+    auto block = std::make_shared<std::vector<node_t>>();
+    block->reserve( header.size );
+    counters().allocation();
+    
+    result.root_ = load_subtree( reader, header.size, 0, block );
+    result.size_ = header.size;
+    if( !reader.good ||
+        ( reader.has_shape && reader.shape_checksum.value() != header.shape_checksum ) ||
+        reader.keys_checksum.value() != header.keys_checksum ) {
+        // Links between nodes of one block would keep the block alive
+        result.root_ = nullptr;
+        result.size_ = 0;
+        for( auto && node : *block ) {
+            node.parent = nullptr;
+            node.child[ left ] = nullptr;
+            node.child[ right ] = nullptr;
+        }
+        
+        return false;
+    }
+    
+    result.lazy_ = lazy_;
+    result.memory_budget_ = memory_budget_;
+    result.key_bytes_ = key_bytes( result.root_.get() );
+    result.adopt( block );
+    swap( result );
+    std::swap( counters(), result.counters() );
+    return true;
+}
+
+template< typename T, typename Compare, typename Statistics >
+auto rb_tree_t< T, Compare, Statistics >::statistics() const -> Statistics const &
+{
+    return counters();
+}
+
+template< typename T, typename Compare, typename Statistics >
+auto rb_tree_t< T, Compare, Statistics >::stats() const -> rb_tree_stats_t<Statistics>
+{
+    rb_tree_stats_t<Statistics> result;
+    result.size = size_;
+    result.counters = counters();
+    
+    for( auto node = root_.get(); node; node = node->child[ left ].get() ) {
+        result.black_height += node->color == color_t::black;
+    }
+    
+    std::vector<node_t const *> level;
+    std::vector<node_t const *> next;
+    if( root_ ) {
+        level.push_back( root_.get() );
+    }
+    while( !level.empty() ) {
+        result.depth_histogram.push_back( level.size() );
+        for( auto node : level ) {
+            for( auto && child : node->child ) {
+                if( child ) {
+                    next.push_back( child.get() );
+                }
+            }
+        }
+        level.swap( next );
+        next.clear();
+    }
+    result.height = result.depth_histogram.size();
+    
+    return result;
+}
+
+template< typename T, typename Compare, typename Statistics >
+template< typename _ForwardIterator, typename _OutputIterator >
+auto rb_tree_t< T, Compare, Statistics >::find_many( _ForwardIterator first, _ForwardIterator last, _OutputIterator out ) const -> _OutputIterator
+{
+    if( tombstones_ ) {
+        for( ; first != last; ++first ) {
+            *out++ = lookup_live( *first ) != nullptr;
+        }
+        
+        return out;
+    }
+    
+    _ForwardIterator keys[ FindGroupSize ];
+    node_t const * nodes[ FindGroupSize ];
+    node_t const * candidates[ FindGroupSize ];
+    
+    while( first != last ) {
+        std::size_t group = 0;
+        for( ; group < FindGroupSize && first != last; ++group, ++first ) {
+            counters().descent();
+            keys[ group ] = first;
+            nodes[ group ] = root_.get();
+            candidates[ group ] = nullptr;
+        }
+        prefetch( root_.get() );
+        
+        for( std::size_t active = group; active != 0; ) {
+            active = 0;
+            for( std::size_t i = 0; i < group; ++i ) {
+                auto node = nodes[ i ];
+                if( !node ) {
+                    continue;
+                }
+                
+                node = find_step( *keys[ i ], node, candidates[ i ], rb_tree_branchless_descent<T, Compare>{} );
+                if( node ) {
+                    prefetch( node );
+                    ++active;
+                }
+                nodes[ i ] = node;
+            }
+        }
+        
+        for( std::size_t i = 0; i < group; ++i ) {
+            *out++ = candidates[ i ] && !less( *keys[ i ], candidates[ i ]->key );
+        }
+    }
+    
+    return out;
+}
+
+template< typename T, typename Compare, typename Statistics >
+bool
+rb_tree_t< T, Compare, Statistics >::compact( std::size_t budget )
+{
+    detach();
+    
+    if( !compact_block_ ) {
+        if( !root_ ) {
+            return true;
+        }
+        
+        compact_block_ = std::make_shared<std::vector<node_t>>();
+        compact_block_->reserve( size_ + tombstones_ );
+        counters().allocation();
+        adopt( compact_block_ );
+        compact_next_ = minimum( root_ );
+    }
+    
+    purge_next_ = nullptr;
+    for( ; compact_next_ && budget != 0; --budget ) {
+        if( compact_block_->size() == compact_block_->capacity() ) {
+            // Inserts ahead of the cursor filled the block, growing it would move the nodes
+            auto capacity = std::max<std::size_t>( compact_block_->capacity() / 4, 16 );
+            compact_block_ = std::make_shared<std::vector<node_t>>();
+            compact_block_->reserve( capacity );
+            counters().allocation();
+            adopt( compact_block_ );
+        }
+        compact_next_ = successor( relocate( compact_next_, compact_block_ ) );
+    }
+    
+    if( compact_next_ ) {
+        return false;
+    }
+    
+    compact_block_ = nullptr;
+    return true;
+}
+
+template< typename T, typename Compare, typename Statistics >
+void
+rb_tree_t< T, Compare, Statistics >::compact()
+{
+    compact_block_ = nullptr;
+    compact_next_ = nullptr;
+    compact( size_ + tombstones_ );
+}
+
+template< typename T, typename Compare, typename Statistics >
+auto rb_tree_t< T, Compare, Statistics >::representation() const -> std::string
 {
     std::ostringstream stream;
     if( root_ ) {
@@ -0,0 +1,187 @@
+#ifndef RB_TREE_FORMAT_HPP
+#define RB_TREE_FORMAT_HPP
+
+#include <algorithm>
+#include <cstddef>
+#include <cstdint>
+#include <cstring>
+#include <functional>
+#include <istream>
+#include <ostream>
+#include <string>
+#include <type_traits>
+
+// Binary image of rb_tree_t written by save() and read by load() and rb_tree_snapshot_t.
+//
+// +--------+----------------------------+---------------------------+
+// | header | shape (optional, preorder) | keys (in-order, aligned)  |
+// +--------+----------------------------+---------------------------+
+//
+// A shape record is the size of the left subtree shifted left by one, with the color in the
+// lowest bit. Without shape the tree is rebuilt perfectly balanced. Integers use native byte order.
+// Keys are in the order of the comparator the tree was saved with, recorded in compare_id.
+
+enum rb_tree_file_flags_t : std::uint32_t {
+    rb_tree_file_shape = 1,
+    rb_tree_file_trivial_keys = 2
+};
+
+struct rb_tree_file_header_t
+{
+    char magic[ 8 ];
+    std::uint32_t version;
+    std::uint32_t flags;
+    std::uint64_t size;
+    std::uint32_t key_size;
+    std::uint32_t key_align;
+    std::uint64_t shape_offset;
+    std::uint64_t keys_offset;
+    std::uint64_t shape_checksum;
+    std::uint64_t keys_checksum;
+    std::uint64_t compare_id;
+
+    static std::uint32_t const current_version = 2;
+
+    void stamp()
+    {
+        std::memcpy( magic, "rb_tree", sizeof( magic ) );
+        version = current_version;
+    }
+
+    bool valid() const
+    {
+        return std::memcmp( magic, "rb_tree", sizeof( magic ) ) == 0 && version == current_version;
+    }
+};
+
+static_assert( sizeof( rb_tree_file_header_t ) == 72, "header layout must not depend on the compiler" );
+
+/**
+ * @brief Identifies the order of keys in a binary image.
+ *
+ * An image is only loaded with the comparator it was saved with, since lookups rely on the order
+ * of its keys. Specialize for other comparators with a distinct value. Comparators without an
+ * identity share the value 0 and cannot be told apart.
+ */
+template< typename Compare >
+struct rb_tree_compare_id
+{
+    static std::uint64_t const value = 0;
+};
+
+template< typename T >
+struct rb_tree_compare_id<std::less<T>>
+{
+    static std::uint64_t const value = 1;
+};
+
+template< typename T >
+struct rb_tree_compare_id<std::greater<T>>
+{
+    static std::uint64_t const value = 2;
+};
+
+/**
+ * @brief FNV-1a hash of a byte stream.
+ */
+class rb_tree_checksum_t
+{
+public:
+    void update( void const * data, std::size_t size )
+    {
+        auto bytes = static_cast<unsigned char const *>( data );
+        for( std::size_t i = 0; i < size; ++i ) {
+            value_ = ( value_ ^ bytes[ i ] ) * 1099511628211ull;
+        }
+    }
+
+    auto value() const -> std::uint64_t
+    {
+        return value_;
+    }
+
+private:
+    std::uint64_t value_ = 14695981039346656037ull;
+};
+
+/**
+ * @brief Writes and reads keys of the binary image.
+ *
+ * Trivially copyable keys are stored as raw bytes and can be used in place from a mapped file.
+ * Specialize for other key types. min_size is the fewest bytes a stored key takes, it bounds the
+ * number of keys a file of given length can hold. read() must fail rather than allocate memory for
+ * data missing from the stream.
+ */
+template< typename T >
+struct rb_tree_key_io
+{
+    static_assert( std::is_trivially_copyable<T>::value, "rb_tree_key_io must be specialized for this key type" );
+
+    static bool const trivial = true;
+    static std::size_t const min_size = sizeof( T );
+
+    static bool write( std::ostream & stream, T const & key, rb_tree_checksum_t & checksum )
+    {
+        checksum.update( &key, sizeof( key ) );
+        return static_cast<bool>( stream.write( reinterpret_cast<char const *>( &key ), sizeof( key ) ) );
+    }
+
+    static bool read( std::istream & stream, T & key, rb_tree_checksum_t & checksum )
+    {
+        if( !stream.read( reinterpret_cast<char *>( &key ), sizeof( key ) ) ) {
+            return false;
+        }
+
+        checksum.update( &key, sizeof( key ) );
+        return true;
+    }
+};
+
+template< typename C, typename Traits, typename Allocator >
+struct rb_tree_key_io<std::basic_string<C, Traits, Allocator>>
+{
+    using string_t = std::basic_string<C, Traits, Allocator>;
+
+    static bool const trivial = false;
+    static std::size_t const min_size = sizeof( std::uint64_t );
+
+    static bool write( std::ostream & stream, string_t const & key, rb_tree_checksum_t & checksum )
+    {
+        std::uint64_t length = key.size();
+        checksum.update( &length, sizeof( length ) );
+        checksum.update( key.data(), key.size() * sizeof( C ) );
+
+        stream.write( reinterpret_cast<char const *>( &length ), sizeof( length ) );
+        stream.write( reinterpret_cast<char const *>( key.data() ), key.size() * sizeof( C ) );
+        return static_cast<bool>( stream );
+    }
+
+    static bool read( std::istream & stream, string_t & key, rb_tree_checksum_t & checksum )
+    {
+        std::uint64_t length;
+        if( !stream.read( reinterpret_cast<char *>( &length ), sizeof( length ) ) ) {
+            return false;
+        }
+
+        // Grows in chunks, so a corrupted length fails at the end of the stream instead of allocating
+        std::size_t const chunk = 65536;
+        key.clear();
+        while( key.size() < length ) {
+            auto size = key.size();
+            auto step = std::min<std::uint64_t>( length - size, chunk );
+            if( step > key.max_size() - size ) {
+                return false;
+            }
+            key.resize( size + std::size_t( step ) );
+            if( !stream.read( reinterpret_cast<char *>( &key[ size ] ), std::streamsize( step * sizeof( C ) ) ) ) {
+                return false;
+            }
+        }
+
+        checksum.update( &length, sizeof( length ) );
+        checksum.update( key.data(), key.size() * sizeof( C ) );
+        return true;
+    }
+};
+
+#endif
@@ -0,0 +1,91 @@
+#ifndef RB_TREE_MEMORY_HPP
+#define RB_TREE_MEMORY_HPP
+
+#include <cstddef>
+#include <functional>
+#include <string>
+#include <vector>
+
+/**
+ * @brief Bytes held by an rb_tree_t, returned by rb_tree_t::memory_usage().
+ */
+struct rb_tree_memory_t
+{
+    // Nodes, including unused slots of node blocks
+    std::size_t nodes = 0;
+    // shared_ptr control blocks, block headers and estimated allocator headers
+    std::size_t overhead = 0;
+    // Heap memory owned by keys, as reported by rb_tree_key_memory
+    std::size_t keys = 0;
+
+    auto total() const -> std::size_t
+    {
+        return nodes + overhead + keys;
+    }
+};
+
+/**
+ * @brief Estimates the bytes a malloc-style allocator takes for a request of size bytes.
+ *
+ * Assumes one word of header and 16-byte granularity, as glibc does.
+ */
+inline auto rb_tree_allocation_size( std::size_t size ) -> std::size_t
+{
+    auto result = ( size + sizeof( std::size_t ) + 15 ) & ~std::size_t( 15 );
+    return result < 32 ? 32 : result;
+}
+
+/**
+ * @brief Estimated size of the shared_ptr control block in front of an object made by make_shared.
+ *
+ * A vtable pointer followed by the use and weak counts.
+ */
+static std::size_t const rb_tree_control_block_size = 2 * sizeof( void * );
+
+/**
+ * @brief Reports heap memory owned by a key for rb_tree_t::memory_usage().
+ *
+ * Keys own nothing by default. Specialize for other key types, setting owns_heap to true.
+ */
+template< typename T >
+struct rb_tree_key_memory
+{
+    static bool const owns_heap = false;
+
+    static auto heap_bytes( T const & /*key*/ ) -> std::size_t
+    {
+        return 0;
+    }
+};
+
+template< typename C, typename Traits, typename Allocator >
+struct rb_tree_key_memory<std::basic_string<C, Traits, Allocator>>
+{
+    static bool const owns_heap = true;
+
+    static auto heap_bytes( std::basic_string<C, Traits, Allocator> const & key ) -> std::size_t
+    {
+        // Short strings are stored inside the object
+        auto object = reinterpret_cast<char const *>( &key );
+        auto data = reinterpret_cast<char const *>( key.data() );
+        std::less<char const *> less;
+        if( !less( data, object ) && less( data, object + sizeof( key ) ) ) {
+            return 0;
+        }
+
+        return ( key.capacity() + 1 ) * sizeof( C );
+    }
+};
+
+template< typename U, typename Allocator >
+struct rb_tree_key_memory<std::vector<U, Allocator>>
+{
+    static bool const owns_heap = true;
+
+    static auto heap_bytes( std::vector<U, Allocator> const & key ) -> std::size_t
+    {
+        return key.capacity() * sizeof( U );
+    }
+};
+
+#endif
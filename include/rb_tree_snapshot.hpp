@@ -0,0 +1,206 @@
+#ifndef RB_TREE_SNAPSHOT_HPP
+#define RB_TREE_SNAPSHOT_HPP
+
+#include <algorithm>
+#include <cstdint>
+#include <functional>
+#include <string>
+#include <type_traits>
+#include <utility>
+
+#if !defined( __unix__ ) && !defined( __APPLE__ )
+#error "rb_tree_snapshot.hpp maps files with POSIX mmap and is not available on this platform"
+#endif
+
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+#include "rb_tree_format.hpp"
+
+/**
+ * @brief Read-only tree mapped from an image written by rb_tree_t::save().
+ *
+ * Keys are used in place from the mapping: opening costs no allocation and no copy.
+ * Lookups are binary searches over the in-order key array, which is the same order
+ * a tree walk would produce. Only images saved by a tree with the same Compare can be opened.
+ *
+ * POSIX only: the file is mapped with mmap.
+ */
+template< typename T, typename Compare = std::less<T> >
+class rb_tree_snapshot_t
+{
+    static_assert( rb_tree_key_io<T>::trivial, "only trivially copyable keys can be mapped" );
+
+public:
+    rb_tree_snapshot_t() = default;
+
+    explicit rb_tree_snapshot_t( Compare compare ) : compare_{ compare }
+    {
+    }
+
+    rb_tree_snapshot_t( rb_tree_snapshot_t const & ) = delete;
+    auto operator =( rb_tree_snapshot_t const & ) -> rb_tree_snapshot_t & = delete;
+
+    rb_tree_snapshot_t( rb_tree_snapshot_t && other )
+    {
+        swap( other );
+    }
+
+    auto operator =( rb_tree_snapshot_t && other ) -> rb_tree_snapshot_t &
+    {
+        if( this != &other ) {
+            close();
+            swap( other );
+        }
+
+        return *this;
+    }
+
+    ~rb_tree_snapshot_t()
+    {
+        close();
+    }
+
+    void swap( rb_tree_snapshot_t & other )
+    {
+        std::swap( data_, other.data_ );
+        std::swap( length_, other.length_ );
+        std::swap( keys_, other.keys_ );
+        std::swap( size_, other.size_ );
+        std::swap( compare_, other.compare_ );
+    }
+
+    /**
+     * @brief Maps an image.
+     *
+     * @param path File written by rb_tree_t::save().
+     * @param verify Check the keys checksum, which reads the whole file.
+     *
+     * @return true on success.
+     */
+    bool open( std::string const & path, bool verify = true );
+    void close();
+
+    auto size() const -> std::size_t
+    {
+        return size_;
+    }
+
+    auto begin() const -> T const *
+    {
+        return keys_;
+    }
+
+    auto end() const -> T const *
+    {
+        return keys_ + size_;
+    }
+
+    bool contains( T const & key ) const
+    {
+        auto it = std::lower_bound( begin(), end(), key, compare_ );
+        return it != end() && !compare_( key, *it );
+    }
+
+    /**
+     * @brief Returns pointer on n-th key in order, starting from 1, or nullptr.
+     */
+    auto select( std::size_t n ) const -> T const *
+    {
+        return n != 0 && n <= size_ ? keys_ + n - 1 : nullptr;
+    }
+
+    /**
+     * @brief Returns number of keys less than key.
+     */
+    auto rank( T const & key ) const -> std::size_t
+    {
+        return std::lower_bound( begin(), end(), key, compare_ ) - begin();
+    }
+
+    template< typename F >
+    void for_each( F f ) const
+    {
+        std::for_each( begin(), end(), f );
+    }
+
+private:
+    void * data_ = nullptr;
+    std::size_t length_ = 0;
+    T const * keys_ = nullptr;
+    std::size_t size_ = 0;
+    Compare compare_;
+};
+
+template< typename T, typename Compare >
+bool
+rb_tree_snapshot_t< T, Compare >::open( std::string const & path, bool verify )
+{
+    close();
+
+    auto fd = ::open( path.c_str(), O_RDONLY );
+    if( fd < 0 ) {
+        return false;
+    }
+
+    struct stat status;
+    if( ::fstat( fd, &status ) != 0 || std::size_t( status.st_size ) < sizeof( rb_tree_file_header_t ) ) {
+        ::close( fd );
+        return false;
+    }
+
+    std::size_t length = status.st_size;
+    auto data = ::mmap( nullptr, length, PROT_READ, MAP_PRIVATE, fd, 0 );
+    ::close( fd );
+    if( data == MAP_FAILED ) {
+        return false;
+    }
+
+    rb_tree_file_header_t header;
+    std::memcpy( &header, data, sizeof( header ) );
+
+    auto valid = header.valid() &&
+                 ( header.flags & rb_tree_file_trivial_keys ) != 0 &&
+                 header.key_size == sizeof( T ) &&
+                 header.compare_id == rb_tree_compare_id<Compare>::value &&
+                 header.keys_offset % alignof( T ) == 0 &&
+                 header.keys_offset <= length &&
+                 header.size <= ( length - header.keys_offset ) / sizeof( T );
+
+    auto keys = reinterpret_cast<T const *>( static_cast<char const *>( data ) + header.keys_offset );
+    if( valid && verify ) {
+        rb_tree_checksum_t checksum;
+        checksum.update( keys, header.size * sizeof( T ) );
+        valid = checksum.value() == header.keys_checksum;
+    }
+
+    if( !valid ) {
+        ::munmap( data, length );
+        return false;
+    }
+
+    data_ = data;
+    length_ = length;
+    keys_ = keys;
+    size_ = header.size;
+
+    return true;
+}
+
+template< typename T, typename Compare >
+void
+rb_tree_snapshot_t< T, Compare >::close()
+{
+    if( data_ ) {
+        ::munmap( data_, length_ );
+    }
+
+    data_ = nullptr;
+    length_ = 0;
+    keys_ = nullptr;
+    size_ = 0;
+}
+
+#endif
@@ -0,0 +1,150 @@
+#ifndef RB_TREE_STATISTICS_HPP
+#define RB_TREE_STATISTICS_HPP
+
+#include <algorithm>
+#include <cstddef>
+#include <cstdint>
+#include <vector>
+
+/**
+ * @brief Default statistics policy of rb_tree_t.
+ *
+ * Every hook is empty and inlined away.
+ */
+struct rb_tree_no_statistics_t
+{
+    void rotation( bool /*left*/ ) {}
+    void insert_fix_up_iteration() {}
+    void remove_fix_up_iteration() {}
+    void recount_walk( std::size_t /*length*/ ) {}
+    void descent() {}
+    void comparison() {}
+    void allocation() {}
+};
+
+/**
+ * @brief Statistics policy counting the work done on hot paths.
+ *
+ * Counters only grow; subtract two snapshots to get the work of an interval.
+ *
+ * Counters are plain integers bumped by const lookups as well, so a tree using this policy
+ * must not be read by several threads at once. rb_tree_no_statistics_t has no such limit.
+ */
+struct rb_tree_statistics_t
+{
+    std::size_t left_rotations = 0;
+    std::size_t right_rotations = 0;
+    std::size_t insert_fix_up_iterations = 0;
+    std::size_t remove_fix_up_iterations = 0;
+    // Walks recounting ancestors in transplant and right_link, and nodes recounted by them
+    std::size_t recount_walks = 0;
+    std::size_t recount_walk_nodes = 0;
+    std::size_t descents = 0;
+    std::size_t comparisons = 0;
+    // Calls to the allocator: one per node or per block of relocated nodes
+    std::size_t allocations = 0;
+
+    void rotation( bool left )
+    {
+        ++( left ? left_rotations : right_rotations );
+    }
+
+    void insert_fix_up_iteration()
+    {
+        ++insert_fix_up_iterations;
+    }
+
+    void remove_fix_up_iteration()
+    {
+        ++remove_fix_up_iterations;
+    }
+
+    void recount_walk( std::size_t length )
+    {
+        ++recount_walks;
+        recount_walk_nodes += length;
+    }
+
+    void descent()
+    {
+        ++descents;
+    }
+
+    void comparison()
+    {
+        ++comparisons;
+    }
+
+    void allocation()
+    {
+        ++allocations;
+    }
+};
+
+/**
+ * @brief Histogram of latencies with power of two buckets.
+ */
+class rb_tree_latency_t
+{
+public:
+    void record( std::uint64_t ns, std::uint64_t count = 1 )
+    {
+        std::size_t bucket = 0;
+        while( bucket + 1 < Buckets && ( std::uint64_t( 1 ) << bucket ) < ns ) {
+            ++bucket;
+        }
+        buckets_[ bucket ] += count;
+        count_ += count;
+    }
+
+    auto count() const -> std::uint64_t
+    {
+        return count_;
+    }
+
+    /**
+     * @brief Returns upper bound of the bucket holding the q-th quantile, in nanoseconds.
+     */
+    auto percentile( double q ) const -> std::uint64_t
+    {
+        std::uint64_t seen = 0;
+        for( std::size_t bucket = 0; bucket < Buckets; ++bucket ) {
+            seen += buckets_[ bucket ];
+            if( seen && seen >= q * count_ ) {
+                return std::uint64_t( 1 ) << bucket;
+            }
+        }
+
+        return 0;
+    }
+
+    void reset()
+    {
+        std::fill( buckets_, buckets_ + Buckets, 0 );
+        count_ = 0;
+    }
+
+private:
+    static std::size_t const Buckets = 40;
+
+    std::uint64_t buckets_[ Buckets ] = {};
+    std::uint64_t count_ = 0;
+};
+
+/**
+ * @brief Shape of a tree together with the counters of its statistics policy.
+ */
+template< typename Statistics >
+struct rb_tree_stats_t
+{
+    std::size_t size = 0;
+    // Number of nodes on the longest path from the root, 0 for an empty tree
+    std::size_t height = 0;
+    // Number of black nodes on any path from the root to a leaf
+    std::size_t black_height = 0;
+    // depth_histogram[ d ] is the number of nodes at depth d, the root has depth 0
+    std::vector<std::size_t> depth_histogram;
+    Statistics counters;
+};
+
+#endif
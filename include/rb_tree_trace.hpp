@@ -0,0 +1,378 @@
+#ifndef RB_TREE_TRACE_HPP
+#define RB_TREE_TRACE_HPP
+
+#include <algorithm>
+#include <chrono>
+#include <cstdint>
+#include <cstring>
+#include <fstream>
+#include <memory>
+#include <string>
+#include <utility>
+#include <vector>
+
+#include "rb_tree.hpp"
+#include "rb_tree_format.hpp"
+
+// Operation traces of rb_tree_t, recorded from a running tree and replayed deterministically.
+//
+// +--------+----------+----------+-----+
+// | header | record 0 | record 1 | ... |
+// +--------+----------+----------+-----+
+//
+// A record is the operation character followed by its argument: the key written by
+// rb_tree_key_io for +, -, ? and r, or a 64-bit position for #. The operations are the ones
+// of the example replay engine:
+//   + key    insert
+//   - key    remove
+//   ? key    contains
+//   # n      select the n-th key, counting from 1
+//   r key    rank
+// The header holds the number of records and a checksum of all of them. Integers use native byte order.
+
+struct rb_tree_trace_header_t
+{
+    char magic[ 8 ];
+    std::uint32_t version;
+    // sizeof key for trivially copyable keys, 0 otherwise
+    std::uint32_t key_size;
+    std::uint64_t count;
+    std::uint64_t checksum;
+
+    static std::uint32_t const current_version = 1;
+
+    void stamp()
+    {
+        std::memcpy( magic, "rb_trace", sizeof( magic ) );
+        version = current_version;
+    }
+
+    bool valid() const
+    {
+        return std::memcmp( magic, "rb_trace", sizeof( magic ) ) == 0 && version == current_version;
+    }
+};
+
+static_assert( sizeof( rb_tree_trace_header_t ) == 32, "header layout must not depend on the compiler" );
+
+template< typename T >
+struct rb_tree_trace_record_t
+{
+    char op;
+    T key;
+    // Position of #, 0 for other operations
+    std::uint64_t n;
+};
+
+/**
+ * @brief Returns index of a trace operation in [0, 5), 5 for unknown operations.
+ */
+inline auto rb_tree_trace_op_index( char op ) -> std::size_t
+{
+    static char const ops[] = { '+', '-', '?', '#', 'r' };
+    return std::size_t( std::find( ops, ops + 5, op ) - ops );
+}
+
+/**
+ * @brief Writes records into a trace file.
+ */
+template< typename T >
+class rb_tree_trace_writer_t
+{
+public:
+    rb_tree_trace_writer_t() = default;
+    rb_tree_trace_writer_t( rb_tree_trace_writer_t const & ) = delete;
+    auto operator =( rb_tree_trace_writer_t const & ) -> rb_tree_trace_writer_t & = delete;
+
+    ~rb_tree_trace_writer_t()
+    {
+        close();
+    }
+
+    /**
+     * @brief Starts a new trace, the file is complete after close().
+     *
+     * @return true on success.
+     */
+    bool open( std::string const & path )
+    {
+        close();
+        stream_.open( path, std::ios::binary | std::ios::trunc );
+        checksum_ = rb_tree_checksum_t{};
+        count_ = 0;
+
+        rb_tree_trace_header_t header;
+        std::memset( &header, 0, sizeof( header ) );
+        stream_.write( reinterpret_cast<char const *>( &header ), sizeof( header ) );
+        return static_cast<bool>( stream_ );
+    }
+
+    void write( rb_tree_trace_record_t<T> const & record )
+    {
+        checksum_.update( &record.op, sizeof( record.op ) );
+        stream_.put( record.op );
+        if( record.op == '#' ) {
+            checksum_.update( &record.n, sizeof( record.n ) );
+            stream_.write( reinterpret_cast<char const *>( &record.n ), sizeof( record.n ) );
+        }
+        else {
+            rb_tree_key_io<T>::write( stream_, record.key, checksum_ );
+        }
+        ++count_;
+    }
+
+    /**
+     * @brief Writes the header, the trace can be read from now on.
+     *
+     * @return true if every record was written.
+     */
+    bool close()
+    {
+        if( !stream_.is_open() ) {
+            return true;
+        }
+
+        rb_tree_trace_header_t header;
+        std::memset( &header, 0, sizeof( header ) );
+        header.stamp();
+        header.key_size = rb_tree_key_io<T>::trivial ? sizeof( T ) : 0;
+        header.count = count_;
+        header.checksum = checksum_.value();
+        stream_.seekp( 0 );
+        stream_.write( reinterpret_cast<char const *>( &header ), sizeof( header ) );
+        stream_.flush();
+
+        auto good = static_cast<bool>( stream_ );
+        stream_.close();
+        return good;
+    }
+
+    auto count() const -> std::uint64_t
+    {
+        return count_;
+    }
+
+private:
+    std::ofstream stream_;
+    rb_tree_checksum_t checksum_;
+    std::uint64_t count_ = 0;
+};
+
+/**
+ * @brief Reads a whole trace written by rb_tree_trace_writer_t.
+ *
+ * @return true on success, false if the file is missing, of another key type, truncated, followed by
+ * other data or corrupted.
+ */
+template< typename T >
+bool rb_tree_trace_load( std::string const & path, std::vector<rb_tree_trace_record_t<T>> & records )
+{
+    std::ifstream stream{ path, std::ios::binary };
+    rb_tree_trace_header_t header;
+    if( !stream.read( reinterpret_cast<char *>( &header ), sizeof( header ) ) || !header.valid() ||
+        header.key_size != ( rb_tree_key_io<T>::trivial ? sizeof( T ) : 0 ) ) {
+        return false;
+    }
+
+    std::vector<rb_tree_trace_record_t<T>> result;
+    rb_tree_checksum_t checksum;
+    for( std::uint64_t i = 0; i < header.count; ++i ) {
+        rb_tree_trace_record_t<T> record{ 0, T{}, 0 };
+        if( !stream.get( record.op ) || rb_tree_trace_op_index( record.op ) == 5 ) {
+            return false;
+        }
+        checksum.update( &record.op, sizeof( record.op ) );
+
+        if( record.op == '#' ) {
+            if( !stream.read( reinterpret_cast<char *>( &record.n ), sizeof( record.n ) ) ) {
+                return false;
+            }
+            checksum.update( &record.n, sizeof( record.n ) );
+        }
+        else if( !rb_tree_key_io<T>::read( stream, record.key, checksum ) ) {
+            return false;
+        }
+
+        result.push_back( std::move( record ) );
+    }
+
+    // Bytes after the last record mean the count in the header is wrong
+    if( stream.peek() != std::ifstream::traits_type::eof() || checksum.value() != header.checksum ) {
+        return false;
+    }
+
+    records.swap( result );
+    return true;
+}
+
+/**
+ * @brief Forwards operations to a tree and writes each of them into a trace.
+ */
+template< typename T, typename Compare = std::less<T>, typename Statistics = rb_tree_no_statistics_t >
+class rb_tree_trace_recorder_t
+{
+public:
+    using tree_t = rb_tree_t<T, Compare, Statistics>;
+
+    rb_tree_trace_recorder_t( tree_t & tree, rb_tree_trace_writer_t<T> & writer ) : tree_( tree ), writer_( writer )
+    {
+    }
+
+    bool insert( T key )
+    {
+        writer_.write( { '+', key, 0 } );
+        return tree_.insert( std::move( key ) );
+    }
+
+    void remove( T key )
+    {
+        writer_.write( { '-', key, 0 } );
+        tree_.remove( std::move( key ) );
+    }
+
+    bool contains( T const & key )
+    {
+        writer_.write( { '?', key, 0 } );
+        return tree_.contains( key );
+    }
+
+    auto select( std::size_t n ) -> std::shared_ptr<T>
+    {
+        writer_.write( { '#', T{}, n } );
+        return tree_.select( n );
+    }
+
+    auto rank( T const & key ) -> std::size_t
+    {
+        writer_.write( { 'r', key, 0 } );
+        return tree_.rank( key );
+    }
+
+    auto tree() -> tree_t &
+    {
+        return tree_;
+    }
+
+private:
+    tree_t & tree_;
+    rb_tree_trace_writer_t<T> & writer_;
+};
+
+struct rb_tree_replay_result_t
+{
+    // Time spent in operations, without memory sampling
+    double seconds = 0;
+    rb_tree_latency_t latency;
+    // Latency of each operation, indexed by rb_tree_trace_op_index()
+    rb_tree_latency_t op_latency[ 5 ];
+    // Hash of all answers, equal for every target that behaves like rb_tree_t
+    std::uint64_t checksum = 0;
+    // Largest value of target.memory() seen
+    std::size_t peak_bytes = 0;
+};
+
+/**
+ * @brief Adapts rb_tree_t to rb_tree_trace_replay() with its default operations.
+ */
+template< typename T, typename Compare = std::less<T>, typename Statistics = rb_tree_no_statistics_t >
+struct rb_tree_trace_target_t
+{
+    rb_tree_t<T, Compare, Statistics> tree;
+
+    void insert( T const & key )
+    {
+        tree.insert( key );
+    }
+
+    void remove( T const & key )
+    {
+        tree.remove( key );
+    }
+
+    bool contains( T const & key )
+    {
+        return tree.contains( key );
+    }
+
+    bool select( std::size_t n, T & key )
+    {
+        return tree.select( n, key );
+    }
+
+    auto rank( T const & key ) -> std::size_t
+    {
+        return tree.rank( key );
+    }
+
+    auto memory() -> std::size_t
+    {
+        return tree.memory_usage().total();
+    }
+};
+
+/**
+ * @brief Runs records against target in order, timing every operation.
+ *
+ * Target needs insert( key ), remove( key ), contains( key ), select( n, key ), rank( key ) and
+ * memory(), see rb_tree_trace_target_t. Answers go into the checksum so targets can be checked
+ * against each other.
+ *
+ * @param sample_period Number of operations between two calls of target.memory().
+ */
+template< typename T, typename Target >
+auto rb_tree_trace_replay( std::vector<rb_tree_trace_record_t<T>> const & records, Target & target,
+                           std::size_t sample_period = 1024 ) -> rb_tree_replay_result_t
+{
+    using steady_t = std::chrono::steady_clock;
+
+    rb_tree_replay_result_t result;
+    rb_tree_checksum_t checksum;
+    // Keys of select answers are hashed the way they are stored, the stream itself fails silently
+    std::ostream discard{ nullptr };
+    T key{};
+
+    std::uint64_t total = 0;
+    for( std::size_t i = 0; i < records.size(); ++i ) {
+        auto && record = records[ i ];
+        auto before = steady_t::now();
+
+        std::uint64_t answer = 0;
+        switch( record.op ) {
+        case '+':
+            target.insert( record.key );
+            break;
+        case '-':
+            target.remove( record.key );
+            break;
+        case '?':
+            answer = target.contains( record.key );
+            break;
+        case '#':
+            answer = target.select( std::size_t( record.n ), key );
+            if( answer ) {
+                rb_tree_key_io<T>::write( discard, key, checksum );
+            }
+            break;
+        default:
+            answer = target.rank( record.key );
+            break;
+        }
+
+        auto ns = std::uint64_t( std::chrono::duration_cast<std::chrono::nanoseconds>( steady_t::now() - before ).count() );
+        total += ns;
+        result.latency.record( ns );
+        result.op_latency[ rb_tree_trace_op_index( record.op ) ].record( ns );
+        checksum.update( &answer, sizeof( answer ) );
+
+        if( sample_period && i % sample_period == 0 ) {
+            result.peak_bytes = std::max( result.peak_bytes, target.memory() );
+        }
+    }
+    result.seconds = total * 1e-9;
+    result.peak_bytes = std::max( result.peak_bytes, target.memory() );
+    result.checksum = checksum.value();
+
+    return result;
+}
+
+#endif
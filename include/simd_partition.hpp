@@ -0,0 +1,523 @@
+#ifndef SIMD_PARTITION_HPP
+#define SIMD_PARTITION_HPP
+
+#include <cstddef>
+#include <cstdint>
+#include <iterator>
+#include <type_traits>
+#include <utility>
+#include <vector>
+
+#if defined(__AVX2__) || defined(__AVX512F__)
+#include <immintrin.h>
+#endif
+
+#include "block_partition.hpp"
+#include "hoare_partition.hpp"
+#include "partition.hpp"
+
+// Three-way partition of contiguous arithmetic ranges, classifying a vector of elements per step.
+//
+// The range is split twice: first into < pivot and the rest, then the rest into == pivot and > pivot.
+// Each split reads vectors from both ends and writes the lanes of each side next to the ones
+// already placed, so only two vectors of elements are ever kept aside. With AVX-512 the sides
+// are written by compress-store, with AVX2 by one permutation from a table indexed by the mask.
+// Without these instruction sets, or for other types, block_partition or hoare_partition is used.
+// Contiguous iterators are handled through pointers, and the pivot is converted to the element type
+// when comparisons with it take place in that type anyway.
+
+/**
+ * @brief Tells whether elements of an iterator range lie contiguously in memory.
+ *
+ * True for pointers and iterators of std::vector, may be specialized for other iterators.
+ */
+template< typename _Iterator, typename T = typename std::iterator_traits<_Iterator>::value_type >
+struct is_contiguous_iterator : std::integral_constant<bool,
+    std::is_pointer<_Iterator>::value ||
+    ( !std::is_same<T, bool>::value && std::is_same<_Iterator, typename std::vector<T>::iterator>::value )>
+{
+};
+
+namespace simd_partition_detail
+{
+    template< typename T, typename = void >
+    struct kernel_t
+    {
+        static bool const enabled = false;
+    };
+
+#if defined(__AVX512F__)
+
+    template< typename T >
+    struct kernel_t<T, typename std::enable_if<sizeof( T ) == 4 && std::is_integral<T>::value>::type>
+    {
+        static bool const enabled = true;
+        static std::size_t const lanes = 16;
+        using vector_t = __m512i;
+
+        static auto broadcast( T value ) -> vector_t
+        {
+            return _mm512_set1_epi32( value );
+        }
+
+        static auto load( T const * data ) -> vector_t
+        {
+            return _mm512_loadu_si512( data );
+        }
+
+        static unsigned less( vector_t lhs, vector_t rhs )
+        {
+            return std::is_signed<T>::value ? _mm512_cmplt_epi32_mask( lhs, rhs ) : _mm512_cmplt_epu32_mask( lhs, rhs );
+        }
+
+        static void store( vector_t value, unsigned mask, T * left, T * right_end )
+        {
+            auto count = __builtin_popcount( mask );
+            _mm512_mask_compressstoreu_epi32( left, __mmask16( mask ), value );
+            _mm512_mask_compressstoreu_epi32( right_end - ( lanes - count ), __mmask16( ~mask ), value );
+        }
+    };
+
+    template< typename T >
+    struct kernel_t<T, typename std::enable_if<sizeof( T ) == 8 && std::is_integral<T>::value>::type>
+    {
+        static bool const enabled = true;
+        static std::size_t const lanes = 8;
+        using vector_t = __m512i;
+
+        static auto broadcast( T value ) -> vector_t
+        {
+            return _mm512_set1_epi64( value );
+        }
+
+        static auto load( T const * data ) -> vector_t
+        {
+            return _mm512_loadu_si512( data );
+        }
+
+        static unsigned less( vector_t lhs, vector_t rhs )
+        {
+            return std::is_signed<T>::value ? _mm512_cmplt_epi64_mask( lhs, rhs ) : _mm512_cmplt_epu64_mask( lhs, rhs );
+        }
+
+        static void store( vector_t value, unsigned mask, T * left, T * right_end )
+        {
+            auto count = __builtin_popcount( mask );
+            _mm512_mask_compressstoreu_epi64( left, __mmask8( mask ), value );
+            _mm512_mask_compressstoreu_epi64( right_end - ( lanes - count ), __mmask8( ~mask ), value );
+        }
+    };
+
+    template<>
+    struct kernel_t<float>
+    {
+        static bool const enabled = true;
+        static std::size_t const lanes = 16;
+        using vector_t = __m512;
+
+        static auto broadcast( float value ) -> vector_t
+        {
+            return _mm512_set1_ps( value );
+        }
+
+        static auto load( float const * data ) -> vector_t
+        {
+            return _mm512_loadu_ps( data );
+        }
+
+        static unsigned less( vector_t lhs, vector_t rhs )
+        {
+            return _mm512_cmp_ps_mask( lhs, rhs, _CMP_LT_OQ );
+        }
+
+        static void store( vector_t value, unsigned mask, float * left, float * right_end )
+        {
+            auto count = __builtin_popcount( mask );
+            _mm512_mask_compressstoreu_ps( left, __mmask16( mask ), value );
+            _mm512_mask_compressstoreu_ps( right_end - ( lanes - count ), __mmask16( ~mask ), value );
+        }
+    };
+
+    template<>
+    struct kernel_t<double>
+    {
+        static bool const enabled = true;
+        static std::size_t const lanes = 8;
+        using vector_t = __m512d;
+
+        static auto broadcast( double value ) -> vector_t
+        {
+            return _mm512_set1_pd( value );
+        }
+
+        static auto load( double const * data ) -> vector_t
+        {
+            return _mm512_loadu_pd( data );
+        }
+
+        static unsigned less( vector_t lhs, vector_t rhs )
+        {
+            return _mm512_cmp_pd_mask( lhs, rhs, _CMP_LT_OQ );
+        }
+
+        static void store( vector_t value, unsigned mask, double * left, double * right_end )
+        {
+            auto count = __builtin_popcount( mask );
+            _mm512_mask_compressstoreu_pd( left, __mmask8( mask ), value );
+            _mm512_mask_compressstoreu_pd( right_end - ( lanes - count ), __mmask8( ~mask ), value );
+        }
+    };
+
+#elif defined(__AVX2__)
+
+    /**
+     * @brief Permutations moving lanes selected by a mask to the front and the others to the back.
+     *
+     * Entries hold 32-bit lane indices, a 64-bit lane is moved as two 32-bit lanes.
+     */
+    template< std::size_t Lanes >
+    struct permutation_table_t
+    {
+        std::uint32_t indices[ 1 << Lanes ][ 8 ];
+
+        permutation_table_t()
+        {
+            std::size_t const width = 8 / Lanes;
+            for( std::size_t mask = 0; mask < ( 1 << Lanes ); ++mask ) {
+                std::size_t front = 0;
+                std::size_t back = __builtin_popcount( mask );
+                for( std::size_t lane = 0; lane < Lanes; ++lane ) {
+                    auto position = ( mask >> lane ) & 1 ? front++ : back++;
+                    for( std::size_t part = 0; part < width; ++part ) {
+                        indices[ mask ][ position * width + part ] = std::uint32_t( lane * width + part );
+                    }
+                }
+            }
+        }
+
+        static auto instance() -> permutation_table_t const &
+        {
+            static permutation_table_t const table;
+            return table;
+        }
+    };
+
+    template< std::size_t Lanes >
+    inline void store_permuted( __m256i value, unsigned mask, void * left, void * right_end )
+    {
+        auto indices = _mm256_loadu_si256( reinterpret_cast<__m256i const *>( permutation_table_t<Lanes>::instance().indices[ mask ] ) );
+        auto permuted = _mm256_permutevar8x32_epi32( value, indices );
+        // Both stores write whole vectors, lanes of the other side land in space already read
+        _mm256_storeu_si256( reinterpret_cast<__m256i *>( left ), permuted );
+        _mm256_storeu_si256( reinterpret_cast<__m256i *>( right_end ) - 1, permuted );
+    }
+
+    template< typename T >
+    struct kernel_t<T, typename std::enable_if<sizeof( T ) == 4 && std::is_integral<T>::value>::type>
+    {
+        static bool const enabled = true;
+        static std::size_t const lanes = 8;
+        using vector_t = __m256i;
+
+        // Unsigned keys are compared as signed ones with the highest bit flipped
+        static auto bias( vector_t value ) -> vector_t
+        {
+            return std::is_signed<T>::value ? value : _mm256_xor_si256( value, _mm256_set1_epi32( INT32_MIN ) );
+        }
+
+        static auto broadcast( T value ) -> vector_t
+        {
+            return _mm256_set1_epi32( value );
+        }
+
+        static auto load( T const * data ) -> vector_t
+        {
+            return _mm256_loadu_si256( reinterpret_cast<__m256i const *>( data ) );
+        }
+
+        static unsigned less( vector_t lhs, vector_t rhs )
+        {
+            return _mm256_movemask_ps( _mm256_castsi256_ps( _mm256_cmpgt_epi32( bias( rhs ), bias( lhs ) ) ) );
+        }
+
+        static void store( vector_t value, unsigned mask, T * left, T * right_end )
+        {
+            store_permuted<lanes>( value, mask, left, right_end );
+        }
+    };
+
+    template< typename T >
+    struct kernel_t<T, typename std::enable_if<sizeof( T ) == 8 && std::is_integral<T>::value>::type>
+    {
+        static bool const enabled = true;
+        static std::size_t const lanes = 4;
+        using vector_t = __m256i;
+
+        static auto bias( vector_t value ) -> vector_t
+        {
+            return std::is_signed<T>::value ? value : _mm256_xor_si256( value, _mm256_set1_epi64x( INT64_MIN ) );
+        }
+
+        static auto broadcast( T value ) -> vector_t
+        {
+            return _mm256_set1_epi64x( value );
+        }
+
+        static auto load( T const * data ) -> vector_t
+        {
+            return _mm256_loadu_si256( reinterpret_cast<__m256i const *>( data ) );
+        }
+
+        static unsigned less( vector_t lhs, vector_t rhs )
+        {
+            return _mm256_movemask_pd( _mm256_castsi256_pd( _mm256_cmpgt_epi64( bias( rhs ), bias( lhs ) ) ) );
+        }
+
+        static void store( vector_t value, unsigned mask, T * left, T * right_end )
+        {
+            store_permuted<lanes>( value, mask, left, right_end );
+        }
+    };
+
+    template<>
+    struct kernel_t<float>
+    {
+        static bool const enabled = true;
+        static std::size_t const lanes = 8;
+        using vector_t = __m256;
+
+        static auto broadcast( float value ) -> vector_t
+        {
+            return _mm256_set1_ps( value );
+        }
+
+        static auto load( float const * data ) -> vector_t
+        {
+            return _mm256_loadu_ps( data );
+        }
+
+        static unsigned less( vector_t lhs, vector_t rhs )
+        {
+            return _mm256_movemask_ps( _mm256_cmp_ps( lhs, rhs, _CMP_LT_OQ ) );
+        }
+
+        static void store( vector_t value, unsigned mask, float * left, float * right_end )
+        {
+            store_permuted<lanes>( _mm256_castps_si256( value ), mask, left, right_end );
+        }
+    };
+
+    template<>
+    struct kernel_t<double>
+    {
+        static bool const enabled = true;
+        static std::size_t const lanes = 4;
+        using vector_t = __m256d;
+
+        static auto broadcast( double value ) -> vector_t
+        {
+            return _mm256_set1_pd( value );
+        }
+
+        static auto load( double const * data ) -> vector_t
+        {
+            return _mm256_loadu_pd( data );
+        }
+
+        static unsigned less( vector_t lhs, vector_t rhs )
+        {
+            return _mm256_movemask_pd( _mm256_cmp_pd( lhs, rhs, _CMP_LT_OQ ) );
+        }
+
+        static void store( vector_t value, unsigned mask, double * left, double * right_end )
+        {
+            store_permuted<lanes>( _mm256_castpd_si256( value ), mask, left, right_end );
+        }
+    };
+
+#endif
+
+    // Elements less than pivot go to the left side
+    struct less_side_t
+    {
+        template< typename Kernel, typename Vector >
+        static unsigned mask( Vector value, Vector pivot )
+        {
+            return Kernel::less( value, pivot );
+        }
+
+        template< typename T >
+        static bool test( T const & value, T const & pivot )
+        {
+            return value < pivot;
+        }
+    };
+
+    // Elements not greater than pivot go to the left side
+    struct not_greater_side_t
+    {
+        template< typename Kernel, typename Vector >
+        static unsigned mask( Vector value, Vector pivot )
+        {
+            return ~Kernel::less( pivot, value ) & ( ( 1u << Kernel::lanes ) - 1 );
+        }
+
+        template< typename T >
+        static bool test( T const & value, T const & pivot )
+        {
+            return !( pivot < value );
+        }
+    };
+
+    /**
+     * @brief Moves elements of the left side before the others.
+     *
+     * @return Pointer past the last element of the left side.
+     */
+    template< typename Side, typename T >
+    T * split( T * first, T * last, T pivot )
+    {
+        using kernel = kernel_t<T>;
+        std::size_t const lanes = kernel::lanes;
+
+        // Two vectors are kept aside to make room for writes, the unread tail joins them at the end
+        T aside[ 3 * lanes ];
+        std::size_t aside_size = 0;
+
+        auto write_left = first;
+        auto write_right = last;
+        auto read_left = first;
+        auto read_right = last;
+
+        if( std::size_t( last - first ) >= 2 * lanes ) {
+            for( std::size_t i = 0; i < lanes; ++i ) {
+                aside[ aside_size++ ] = *read_left++;
+                aside[ aside_size++ ] = *--read_right;
+            }
+
+            auto vector_pivot = kernel::broadcast( pivot );
+            while( std::size_t( read_right - read_left ) >= lanes ) {
+                // Reading from the side with less room keeps at least one vector of room on both sides
+                T * source;
+                if( read_left - write_left <= write_right - read_right ) {
+                    source = read_left;
+                    read_left += lanes;
+                }
+                else {
+                    read_right -= lanes;
+                    source = read_right;
+                }
+
+                auto value = kernel::load( source );
+                auto mask = Side::template mask<kernel>( value, vector_pivot );
+                kernel::store( value, mask, write_left, write_right );
+
+                auto count = __builtin_popcount( mask );
+                write_left += count;
+                write_right -= lanes - count;
+            }
+        }
+
+        while( read_left != read_right ) {
+            aside[ aside_size++ ] = *read_left++;
+        }
+
+        for( std::size_t i = 0; i < aside_size; ++i ) {
+            if( Side::test( aside[ i ], pivot ) ) {
+                *write_left++ = aside[ i ];
+            }
+            else {
+                *--write_right = aside[ i ];
+            }
+        }
+
+        return write_left;
+    }
+
+    /**
+     * @brief Partitions with the vector kernel, pivot must be of the element type.
+     */
+    template< typename T >
+    auto partition( T * first, T * last, T pivot ) -> parition_t<T *>
+    {
+        auto equal = split<less_side_t>( first, last, pivot );
+        auto great = split<not_greater_side_t>( equal, last, pivot );
+
+        return {{first, equal - first}, {equal, great - equal}, {great, last - great}};
+    }
+
+    // Comparing T with U takes place in T, so converting the pivot to T first changes no result
+    template< typename T, typename U, bool = std::is_arithmetic<U>::value >
+    struct same_comparison_t : std::is_same<typename std::common_type<T, U>::type, T>
+    {
+    };
+
+    template< typename T, typename U >
+    struct same_comparison_t<T, U, false> : std::false_type
+    {
+    };
+
+    /**
+     * @brief Tells whether simd_partition uses a vector kernel for a range and a pivot type.
+     */
+    template< typename _Iterator, typename U, typename T = typename std::iterator_traits<_Iterator>::value_type >
+    struct vectorized_t : std::integral_constant<bool,
+        kernel_t<T>::enabled && is_contiguous_iterator<_Iterator>::value && same_comparison_t<T, U>::value>
+    {
+    };
+
+    template< typename _RandomAccessIterator, typename T >
+    auto dispatch( _RandomAccessIterator first, _RandomAccessIterator last, T const & pivot, std::true_type )
+        -> parition_t<_RandomAccessIterator>
+    {
+        using value_t = typename std::iterator_traits<_RandomAccessIterator>::value_type;
+        if( first == last ) {
+            return {{first, 0}, {first, 0}, {first, 0}};
+        }
+
+        auto data = &*first;
+        auto parts = partition( data, data + ( last - first ), value_t( pivot ) );
+        return {{first, parts.less.size},
+                {first + ( parts.equal.begin - data ), parts.equal.size},
+                {first + ( parts.great.begin - data ), parts.great.size}};
+    }
+
+    template< typename _RandomAccessIterator, typename T >
+    auto fallback( _RandomAccessIterator first, _RandomAccessIterator last, T const & pivot, std::random_access_iterator_tag )
+        -> parition_t<_RandomAccessIterator>
+    {
+        return block_partition( first, last, pivot );
+    }
+
+    template< typename _BidirectionalIterator, typename T >
+    auto fallback( _BidirectionalIterator first, _BidirectionalIterator last, T const & pivot, std::bidirectional_iterator_tag )
+        -> parition_t<_BidirectionalIterator>
+    {
+        return hoare_partition( first, last, pivot );
+    }
+
+    template< typename _BidirectionalIterator, typename T >
+    auto dispatch( _BidirectionalIterator first, _BidirectionalIterator last, T const & pivot, std::false_type )
+        -> parition_t<_BidirectionalIterator>
+    {
+        return fallback( first, last, pivot, typename std::iterator_traits<_BidirectionalIterator>::iterator_category{} );
+    }
+}
+
+/**
+ * @brief Three-way partition, by vectors for contiguous ranges of arithmetic elements.
+ *
+ * Elements are compared with operator < like in hoare_partition, NaNs end up with the equal ones.
+ * The order of elements inside each part is unspecified. Ranges without a vector kernel, see
+ * simd_partition_detail::vectorized_t, fall back to block_partition for random-access iterators
+ * and to hoare_partition for others.
+ *
+ * @return Ranges of elements less than, equal to and greater than pivot.
+ */
+template< typename _BidirectionalIterator, typename T >
+auto simd_partition( _BidirectionalIterator first, _BidirectionalIterator last, T pivot ) -> parition_t<_BidirectionalIterator>
+{
+    return simd_partition_detail::dispatch( first, last, pivot, simd_partition_detail::vectorized_t<_BidirectionalIterator, T>{} );
+}
+
+#endif
@@ -0,0 +1,141 @@
+#ifndef SLIDING_QUANTILE_HPP
+#define SLIDING_QUANTILE_HPP
+
+#include <cstddef>
+#include <functional>
+#include <iterator>
+#include <stdexcept>
+#include <utility>
+#include <vector>
+
+#include "rb_tree.hpp"
+
+/**
+ * @brief Order statistics of the last window samples of a stream.
+ *
+ * Samples are kept in arrival order in a ring buffer and in sorted order in an rb_tree_t.
+ * Once the window is full, every push replaces the expiring sample by the new one in one
+ * rb_tree_t::replace(), which reuses the node of the expiring sample. Quantiles are found
+ * by rank in O(log window) and copied out without allocation.
+ */
+template< typename T, typename Compare = std::less<T> >
+class sliding_quantile_t
+{
+public:
+    /**
+     * @param window Number of latest samples kept, must be positive.
+     *
+     * @throw std::invalid_argument if window is 0.
+     */
+    explicit sliding_quantile_t( std::size_t window, Compare compare = Compare{} )
+        : window_{ window }, tree_{ compare }
+    {
+        if( window == 0 ) {
+            throw std::invalid_argument( "sliding_quantile_t: window must be positive" );
+        }
+        samples_.reserve( window );
+    }
+
+    /**
+     * @brief Adds sample, the oldest sample expires if the window is full.
+     */
+    void push( T sample )
+    {
+        if( samples_.size() < window_ ) {
+            samples_.push_back( sample );
+            tree_.insert( std::move( sample ) );
+            if( samples_.size() == window_ ) {
+                // Nodes are reused from now on, so they stay in one block
+                tree_.compact();
+            }
+            return;
+        }
+
+        auto & oldest = samples_[ next_ ];
+        tree_.replace( oldest, sample );
+        oldest = std::move( sample );
+        next_ = next_ + 1 == window_ ? 0 : next_ + 1;
+    }
+
+    void clear()
+    {
+        samples_.clear();
+        tree_.clear();
+        next_ = 0;
+    }
+
+    /**
+     * @brief Returns number of samples in the window.
+     */
+    auto size() const -> std::size_t
+    {
+        return samples_.size();
+    }
+
+    auto window() const -> std::size_t
+    {
+        return window_;
+    }
+
+    /**
+     * @brief Returns the sample of nearest rank ceil( fraction * size() ).
+     *
+     * quantile( 0.5 ) is the lower median, quantile( 0 ) the minimum and quantile( 1 ) the maximum.
+     * The window must not be empty.
+     *
+     * @param fraction Value in [0, 1], e.g. 0.99 for p99.
+     */
+    auto quantile( double fraction ) const -> T
+    {
+        T result{};
+        tree_.select( rank( fraction ), result );
+        return result;
+    }
+
+    /**
+     * @brief Writes the quantile of every fraction of a range in its order.
+     *
+     * @return Iterator past the last written sample.
+     */
+    template< typename _InputIterator, typename _OutputIterator >
+    auto quantiles( _InputIterator first, _InputIterator last, _OutputIterator out ) const -> _OutputIterator
+    {
+        for( ; first != last; ++first ) {
+            *out++ = quantile( *first );
+        }
+
+        return out;
+    }
+
+    /**
+     * @brief Returns the samples of the window in sorted order.
+     */
+    auto tree() const -> rb_tree_t<T, Compare> const &
+    {
+        return tree_;
+    }
+
+private:
+    std::size_t window_;
+    // Ring buffer, the oldest sample is at next_ once the window is full
+    std::vector<T> samples_;
+    std::size_t next_ = 0;
+    rb_tree_t<T, Compare> tree_;
+
+    auto rank( double fraction ) const -> std::size_t
+    {
+        auto size = samples_.size();
+        auto scaled = fraction * double( size );
+        if( !( scaled > 1 ) ) {
+            return 1;
+        }
+        if( !( scaled < double( size ) ) ) {
+            return size;
+        }
+
+        auto result = std::size_t( scaled );
+        return double( result ) < scaled ? result + 1 : result;
+    }
+};
+
+#endif
@@ -0,0 +1,127 @@
+#ifndef THREAD_POOL_HPP
+#define THREAD_POOL_HPP
+
+#include <atomic>
+#include <condition_variable>
+#include <cstddef>
+#include <functional>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+/**
+ * @brief Fixed set of threads running indexed tasks.
+ *
+ * The thread calling run() takes part in the work, so a pool of size n starts n - 1 threads.
+ * Tasks must not throw.
+ */
+class thread_pool_t
+{
+public:
+    /**
+     * @param size Number of threads taking part in run(), the hardware concurrency by default.
+     */
+    explicit thread_pool_t( std::size_t size = std::thread::hardware_concurrency() )
+    {
+        for( std::size_t i = 1; i < size; ++i ) {
+            threads_.emplace_back( [this] { work(); } );
+        }
+    }
+
+    thread_pool_t( thread_pool_t const & ) = delete;
+    auto operator =( thread_pool_t const & ) -> thread_pool_t & = delete;
+
+    ~thread_pool_t()
+    {
+        {
+            std::lock_guard<std::mutex> lock{ mutex_ };
+            stop_ = true;
+        }
+        wake_.notify_all();
+
+        for( auto && thread : threads_ ) {
+            thread.join();
+        }
+    }
+
+    auto size() const -> std::size_t
+    {
+        return threads_.size() + 1;
+    }
+
+    /**
+     * @brief Calls task( i ) for every i in [0, count) and waits until all calls return.
+     */
+    template< typename F >
+    void run( std::size_t count, F && task )
+    {
+        batch_t batch;
+        batch.task = std::ref( task );
+        batch.count = count;
+
+        {
+            std::lock_guard<std::mutex> lock{ mutex_ };
+            batch_ = &batch;
+            ++generation_;
+        }
+        wake_.notify_all();
+
+        process( batch );
+
+        // Every task is taken, wait for the ones still running on other threads
+        std::unique_lock<std::mutex> lock{ mutex_ };
+        batch_ = nullptr;
+        idle_.wait( lock, [&] { return batch.workers == 0; } );
+    }
+
+private:
+    struct batch_t
+    {
+        std::function<void( std::size_t )> task;
+        std::size_t count = 0;
+        std::atomic<std::size_t> next{ 0 };
+        // Threads other than the caller working on the batch, guarded by mutex_
+        std::size_t workers = 0;
+    };
+
+    std::vector<std::thread> threads_;
+    std::mutex mutex_;
+    std::condition_variable wake_;
+    std::condition_variable idle_;
+    batch_t * batch_ = nullptr;
+    std::size_t generation_ = 0;
+    bool stop_ = false;
+
+    static void process( batch_t & batch )
+    {
+        for( auto i = batch.next++; i < batch.count; i = batch.next++ ) {
+            batch.task( i );
+        }
+    }
+
+    void work()
+    {
+        std::size_t generation = 0;
+        std::unique_lock<std::mutex> lock{ mutex_ };
+        for( ;; ) {
+            wake_.wait( lock, [&] { return stop_ || ( batch_ && generation_ != generation ); } );
+            if( stop_ ) {
+                return;
+            }
+
+            generation = generation_;
+            auto batch = batch_;
+            ++batch->workers;
+            lock.unlock();
+
+            process( *batch );
+
+            lock.lock();
+            if( --batch->workers == 0 ) {
+                idle_.notify_all();
+            }
+        }
+    }
+};
+
+#endif
@@ -0,0 +1,353 @@
+#include <catch.hpp>
+#include <algorithm>
+#include <atomic>
+#include <cstdint>
+#include <deque>
+#include <list>
+#include <random>
+#include <string>
+#include <vector>
+#include "block_partition.hpp"
+#include "dual_pivot_partition.hpp"
+#include "multiway_partition.hpp"
+#include "parallel_partition.hpp"
+#include "simd_partition.hpp"
+
+namespace
+{
+    template< typename _Iterator, typename T >
+    bool is_partitioned( parition_t<_Iterator> const & result, _Iterator first, _Iterator last, T const & pivot )
+    {
+        if( result.less.begin != first ||
+            std::next( result.less.begin, result.less.size ) != result.equal.begin ||
+            std::next( result.equal.begin, result.equal.size ) != result.great.begin ||
+            std::next( result.great.begin, result.great.size ) != last ) {
+            return false;
+        }
+
+        return std::all_of( result.less.begin, result.equal.begin, [&]( T const & value ) { return value < pivot; } ) &&
+               std::all_of( result.equal.begin, result.great.begin, [&]( T const & value ) { return !( value < pivot ) && !( pivot < value ); } ) &&
+               std::all_of( result.great.begin, last, [&]( T const & value ) { return pivot < value; } );
+    }
+
+    template< typename T >
+    void check_simd_partition( std::mt19937 & random, std::size_t size, T range )
+    {
+        std::vector<T> values( size );
+        for( auto && value : values ) {
+            value = T( random() % std::uint32_t( range ) );
+        }
+        auto pivot = T( random() % std::uint32_t( range ) );
+        auto expected = values;
+
+        auto result = simd_partition( values.data(), values.data() + values.size(), pivot );
+        REQUIRE( is_partitioned( result, values.data(), values.data() + values.size(), pivot ) );
+
+        // Every part holds the elements std::partition puts there
+        auto less = std::partition( expected.begin(), expected.end(), [&]( T const & value ) { return value < pivot; } );
+        auto equal = std::partition( less, expected.end(), [&]( T const & value ) { return !( pivot < value ); } );
+        REQUIRE( result.less.size == less - expected.begin() );
+        REQUIRE( result.equal.size == equal - less );
+
+        auto less_end = values.begin() + result.less.size;
+        std::sort( values.begin(), less_end );
+        std::sort( expected.begin(), less );
+        std::sort( less_end + result.equal.size, values.end() );
+        std::sort( equal, expected.end() );
+        REQUIRE( values == expected );
+    }
+}
+
+TEST_CASE( "arithmetic ranges can be partitioned by vectors", "[partition][simd]" ) {
+    std::mt19937 random{ 17 };
+
+#if defined(__AVX2__) || defined(__AVX512F__)
+    // Built for a vector instruction set, the kernels rather than the fallback are under test
+    REQUIRE( simd_partition_detail::kernel_t<int>::enabled );
+    REQUIRE( simd_partition_detail::kernel_t<std::uint64_t>::enabled );
+    REQUIRE( simd_partition_detail::kernel_t<float>::enabled );
+    REQUIRE( simd_partition_detail::kernel_t<double>::enabled );
+#endif
+
+    for( std::size_t size : { 0, 1, 7, 16, 31, 32, 33, 100, 1000, 4099 } ) {
+        check_simd_partition<int>( random, size, 10 );
+        check_simd_partition<int>( random, size, 100000 );
+        check_simd_partition<std::uint32_t>( random, size, 50 );
+        check_simd_partition<std::int64_t>( random, size, 20 );
+        check_simd_partition<std::uint64_t>( random, size, 1000 );
+        check_simd_partition<float>( random, size, 30 );
+        check_simd_partition<double>( random, size, 30 );
+    }
+
+    SECTION( "with negative and extreme keys" ) {
+        std::vector<int> values = { -5, INT32_MAX, INT32_MIN, 0, -1, 3, 3, -5, 7, INT32_MIN, 2, 9, -8, 3, 4, 1, 0, 6, -3, 5 };
+        auto result = simd_partition( values.data(), values.data() + values.size(), 3 );
+        REQUIRE( is_partitioned( result, values.data(), values.data() + values.size(), 3 ) );
+        REQUIRE( result.less.size == 11 );
+        REQUIRE( result.equal.size == 3 );
+        REQUIRE( result.great.size == 6 );
+
+        std::vector<std::uint32_t> large( 40, 0x80000000u );
+        large[ 3 ] = 1;
+        auto large_result = simd_partition( large.data(), large.data() + large.size(), 0x7fffffffu );
+        REQUIRE( large_result.less.size == 1 );
+        REQUIRE( large_result.great.size == 39 );
+    }
+
+    SECTION( "through vector iterators and converted pivots" ) {
+        using simd_partition_detail::vectorized_t;
+        REQUIRE( vectorized_t<std::vector<int>::iterator, int>::value == simd_partition_detail::kernel_t<int>::enabled );
+        REQUIRE( vectorized_t<float *, int>::value == simd_partition_detail::kernel_t<float>::enabled );
+        REQUIRE( vectorized_t<std::uint32_t *, int>::value == simd_partition_detail::kernel_t<std::uint32_t>::enabled );
+#if defined(__AVX2__) || defined(__AVX512F__)
+        REQUIRE( vectorized_t<std::vector<int>::iterator, int>::value );
+        REQUIRE( vectorized_t<float *, int>::value );
+#endif
+        // Comparisons with a wider pivot would change if it were converted
+        REQUIRE_FALSE( vectorized_t<int *, double>::value );
+        REQUIRE_FALSE( vectorized_t<std::deque<int>::iterator, int>::value );
+        REQUIRE_FALSE( vectorized_t<std::vector<bool>::iterator, bool>::value );
+
+        std::vector<int> values( 1000 );
+        for( auto && value : values ) {
+            value = int( random() % 100 );
+        }
+        auto result = simd_partition( values.begin(), values.end(), 50 );
+        REQUIRE( is_partitioned( result, values.begin(), values.end(), 50 ) );
+
+        std::vector<int> empty;
+        auto empty_result = simd_partition( empty.begin(), empty.end(), 1 );
+        REQUIRE( empty_result.less.begin == empty.end() );
+        REQUIRE( empty_result.great.size == 0 );
+
+        std::vector<float> floats( 100 );
+        for( auto && value : floats ) {
+            value = float( random() % 20 ) - 10.5f;
+        }
+        auto float_result = simd_partition( floats.data(), floats.data() + floats.size(), 0 );
+        REQUIRE( is_partitioned( float_result, floats.data(), floats.data() + floats.size(), 0.0f ) );
+
+        auto half = simd_partition( values.data(), values.data() + values.size(), 49.5 );
+        REQUIRE( is_partitioned( half, values.data(), values.data() + values.size(), 49.5 ) );
+        REQUIRE( half.equal.size == 0 );
+    }
+
+    SECTION( "with other types" ) {
+        std::vector<std::string> strings = { "d", "a", "c", "b", "c", "e" };
+        auto result = simd_partition( strings.begin(), strings.end(), std::string( "c" ) );
+        REQUIRE( is_partitioned( result, strings.begin(), strings.end(), std::string( "c" ) ) );
+        REQUIRE( result.equal.size == 2 );
+
+        std::list<int> list = { 5, 1, 4, 2, 3 };
+        auto list_result = simd_partition( list.begin(), list.end(), 3 );
+        REQUIRE( is_partitioned( list_result, list.begin(), list.end(), 3 ) );
+    }
+}
+
+TEST_CASE( "random-access ranges can be partitioned by blocks", "[partition][block]" ) {
+    std::mt19937 random{ 23 };
+
+    for( std::size_t size : { 0, 1, 2, 63, 64, 128, 129, 200, 1000, 10007 } ) {
+        for( int range : { 1, 3, 1000 } ) {
+            std::vector<int> values( size );
+            for( auto && value : values ) {
+                value = int( random() % range );
+            }
+            auto pivot = int( random() % range );
+            auto expected = values;
+
+            auto result = block_partition( values.begin(), values.end(), pivot );
+            REQUIRE( is_partitioned( result, values.begin(), values.end(), pivot ) );
+            REQUIRE( result.less.size == std::count_if( expected.begin(), expected.end(), [&]( int value ) { return value < pivot; } ) );
+            REQUIRE( result.equal.size == std::count( expected.begin(), expected.end(), pivot ) );
+
+            std::sort( values.begin(), values.end() );
+            std::sort( expected.begin(), expected.end() );
+            REQUIRE( values == expected );
+        }
+    }
+
+    SECTION( "through raw pointers" ) {
+        std::vector<std::string> strings;
+        for( int i = 0; i < 500; ++i ) {
+            strings.push_back( std::to_string( ( i * 37 ) % 101 ) );
+        }
+        auto first = &strings[ 0 ];
+        auto last = first + strings.size();
+        auto result = block_partition( first, last, std::string( "50" ) );
+        REQUIRE( is_partitioned( result, first, last, std::string( "50" ) ) );
+        REQUIRE( result.equal.size == 5 );
+    }
+
+    SECTION( "through other iterators" ) {
+        std::deque<double> values;
+        for( int i = 0; i < 300; ++i ) {
+            values.push_back( ( i * 13 ) % 29 * 0.5 );
+        }
+        auto result = block_partition( values.begin(), values.end(), 7.0 );
+        REQUIRE( is_partitioned( result, values.begin(), values.end(), 7.0 ) );
+        REQUIRE( result.less.size == 146 );
+    }
+}
+
+TEST_CASE( "tasks can be run on a thread pool", "[thread_pool]" ) {
+    thread_pool_t pool{ 4 };
+    REQUIRE( pool.size() == 4 );
+
+    for( std::size_t count : { 0, 1, 3, 100 } ) {
+        std::vector<std::atomic<int>> calls( count );
+        for( auto && call : calls ) {
+            call = 0;
+        }
+        pool.run( count, [&]( std::size_t i ) { ++calls[ i ]; } );
+        REQUIRE( std::all_of( calls.begin(), calls.end(), []( std::atomic<int> const & call ) { return call == 1; } ) );
+    }
+
+    thread_pool_t single{ 1 };
+    int sum = 0;
+    single.run( 10, [&]( std::size_t i ) { sum += int( i ); } );
+    REQUIRE( sum == 45 );
+}
+
+TEST_CASE( "large ranges can be partitioned in parallel", "[partition][parallel]" ) {
+    std::mt19937 random{ 29 };
+    thread_pool_t pool{ 4 };
+
+    for( std::size_t size : { 0, 1000, 40000, 100003, 1 << 20 } ) {
+        for( unsigned range : { 1u, 7u, 1000000u } ) {
+            std::vector<unsigned> values( size );
+            for( auto && value : values ) {
+                value = random() % range;
+            }
+            auto pivot = random() % range;
+            auto serial = values;
+
+            auto result = parallel_partition( values.begin(), values.end(), pivot, pool );
+            auto expected = block_partition( serial.begin(), serial.end(), pivot );
+            REQUIRE( is_partitioned( result, values.begin(), values.end(), pivot ) );
+            REQUIRE( result.less.size == expected.less.size );
+            REQUIRE( result.equal.size == expected.equal.size );
+            REQUIRE( result.great.size == expected.great.size );
+
+            std::sort( values.begin(), values.end() );
+            std::sort( serial.begin(), serial.end() );
+            REQUIRE( values == serial );
+        }
+    }
+
+    SECTION( "with pointers" ) {
+        std::vector<double> values( 200000 );
+        for( std::size_t i = 0; i < values.size(); ++i ) {
+            values[ i ] = double( ( i * 7919 ) % 1000 );
+        }
+        auto first = values.data();
+        auto last = first + values.size();
+        auto result = parallel_partition( first, last, 500.0, pool );
+        REQUIRE( is_partitioned( result, first, last, 500.0 ) );
+        REQUIRE( result.equal.size == 200 );
+    }
+}
+
+TEST_CASE( "ranges can be partitioned by two pivots", "[partition][dual_pivot]" ) {
+    std::mt19937 random{ 31 };
+
+    for( std::size_t size : { 0, 1, 2, 100, 1000 } ) {
+        std::vector<int> values( size );
+        for( auto && value : values ) {
+            value = int( random() % 50 );
+        }
+        auto expected = values;
+
+        auto result = dual_pivot_partition( values.begin(), values.end(), 10, 30 );
+        REQUIRE( result.less.begin == values.begin() );
+        REQUIRE( result.less.size + result.equal.size + result.great.size == std::ptrdiff_t( size ) );
+        REQUIRE( std::all_of( result.less.begin, result.equal.begin, []( int value ) { return value < 10; } ) );
+        REQUIRE( std::all_of( result.equal.begin, result.great.begin, []( int value ) { return value >= 10 && value <= 30; } ) );
+        REQUIRE( std::all_of( result.great.begin, values.end(), []( int value ) { return value > 30; } ) );
+
+        std::sort( values.begin(), values.end() );
+        std::sort( expected.begin(), expected.end() );
+        REQUIRE( values == expected );
+    }
+
+    std::list<int> list = { 5, 1, 4, 2, 3, 3 };
+    auto result = dual_pivot_partition( list.begin(), list.end(), 3, 3 );
+    REQUIRE( is_partitioned( result, list.begin(), list.end(), 3 ) );
+}
+
+TEST_CASE( "ranges can be distributed into buckets", "[partition][multiway]" ) {
+    std::mt19937 random{ 37 };
+
+    for( std::size_t splitter_count : { 0, 1, 2, 3, 15, 16, 100, 300 } ) {
+        std::vector<int> splitters( splitter_count );
+        for( auto && splitter : splitters ) {
+            splitter = int( random() % 2000 );
+        }
+        std::sort( splitters.begin(), splitters.end() );
+
+        std::vector<int> values( 10000 );
+        for( auto && value : values ) {
+            value = int( random() % 2100 ) - 50;
+        }
+        auto expected = values;
+
+        auto buckets = multiway_partition( values.begin(), values.end(), splitters );
+        REQUIRE( buckets.size() == splitter_count + 1 );
+
+        auto begin = values.begin();
+        for( std::size_t i = 0; i < buckets.size(); ++i ) {
+            REQUIRE( buckets[ i ].begin == begin );
+            auto end = begin + buckets[ i ].size;
+            REQUIRE( std::all_of( begin, end, [&]( int value ) {
+                return ( i == 0 || !( value < splitters[ i - 1 ] ) ) && ( i == splitter_count || value < splitters[ i ] );
+            } ) );
+            begin = end;
+        }
+        REQUIRE( begin == values.end() );
+
+        std::sort( values.begin(), values.end() );
+        std::sort( expected.begin(), expected.end() );
+        REQUIRE( values == expected );
+    }
+
+    SECTION( "with other types" ) {
+        std::vector<std::string> strings = { "pear", "apple", "fig", "kiwi", "banana", "cherry", "plum" };
+        auto buckets = multiway_partition( strings.data(), strings.data() + strings.size(), std::vector<std::string>{ "c", "l" } );
+        REQUIRE( buckets.size() == 3 );
+        REQUIRE( buckets[ 0 ].size == 2 );
+        REQUIRE( buckets[ 1 ].size == 3 );
+        REQUIRE( buckets[ 2 ].size == 2 );
+        REQUIRE( std::is_permutation( buckets[ 0 ].begin, buckets[ 1 ].begin, std::vector<std::string>{ "apple", "banana" }.begin() ) );
+    }
+
+    SECTION( "without default constructor" ) {
+        // Trivially copyable, so it takes the path through the buffer
+        struct key_t
+        {
+            explicit key_t( int aValue ) : value{ aValue }
+            {
+            }
+
+            bool operator <( key_t const & other ) const
+            {
+                return value < other.value;
+            }
+
+            int value;
+        };
+
+        std::vector<key_t> keys;
+        for( int i = 0; i < 1000; ++i ) {
+            keys.emplace_back( ( i * 7 ) % 100 );
+        }
+        auto buckets = multiway_partition( keys.begin(), keys.end(), std::vector<key_t>{ key_t{ 25 }, key_t{ 50 } } );
+        REQUIRE( buckets.size() == 3 );
+        REQUIRE( buckets[ 0 ].size == 250 );
+        REQUIRE( buckets[ 1 ].size == 250 );
+        REQUIRE( std::all_of( buckets[ 2 ].begin, keys.end(), []( key_t const & key ) { return key.value >= 50; } ) );
+
+        auto unsplit = multiway_partition( keys.begin(), keys.end(), std::vector<key_t>{} );
+        REQUIRE( unsplit.size() == 1 );
+        REQUIRE( unsplit[ 0 ].size == 1000 );
+    }
+}
@@ -1,5 +1,12 @@
 #include <catch.hpp>
+#include <algorithm>
+#include <cstdio>
 #include <fstream>
+#include <functional>
+#include <iterator>
+#include <string>
+#include <utility>
+#include <vector>
 #include "rb_tree.hpp"
 
 TEST_CASE( "elements can be inserted in rb tree", "[insert]" ) {
@@ -63,13 +70,7 @@ TEST_CASE( "elements can be removde from rb tree", "[remove]" ) {
 //        std::cout << tree << std::endl;
 //        std::ofstream("tmp") << tree << std::endl;
         
-        //         b2
-        //        /  \
-        //       /    \
-        //     b1      b4
-        //            /  \
-        //           /    \
-        //         r3      r5
+        // b2( b1, b4( r3, r5 ) )
         REQUIRE( tree.representation() == "b1b2r3b4r5" );
         std::cout << tree << std::endl;
         tree.remove( 2 );
@@ -98,7 +99,7 @@ TEST_CASE( "elements can be removed from rb tree ", "[remove, bug]" ) {
             tree.remove( 4 );
             tree.remove( 4 );
             tree.remove( 8 );
-            REQUIRE( tree.representation() == "b1b2b2b6b7b9" );
+            REQUIRE( tree.representation() == "b1r2b2b6r7b9" );
             tree.remove( 9 );
             REQUIRE( tree.representation() == "b1r2b2b6b7" );
         }
@@ -118,7 +119,7 @@ TEST_CASE( "elements can be removed from rb tree ", "[remove, bug]" ) {
             tree.insert( 0 );
             tree.remove( 3 );
             std::cout << tree << std::endl;
-            REQUIRE( tree.representation() == "r0b1b2b4b5b6b7r8r9b10r11" );
+            REQUIRE( tree.representation() == "b0b1b2b4b5b6b7r8r9b10r11" );
             tree.remove( 2 );
             std::cout << tree << std::endl;
             REQUIRE( tree.representation() == "r0b1b4b5b6b7b8r9b10r11" );
@@ -160,7 +161,7 @@ TEST_CASE( "elements can be removed from rb tree ", "[remove, bug]" ) {
             std::cout << tree << std::endl;
             tree.insert( 5 );
             std::cout << tree << std::endl;
-            REQUIRE( tree.representation() == "r0b1b2b4b5b5b5r5b5r5r6b7b8r9b10r11" );
+            REQUIRE( tree.representation() == "b0b1b2b4b5b5b5r5b5r5r6b7b8r9b10r11" );
             tree.remove( 2 );
             std::cout << tree << std::endl;
             REQUIRE( tree.representation() == "r0b1b4b5r5b5b5b5r5b6b7b8r9b10r11" );
@@ -192,4 +193,652 @@ TEST_CASE( "elements can be selected in rb tree ", "[select]" ) {
         REQUIRE( tree.select( 0 ) == nullptr );
         
     }
+    SECTION( "after descending inserts and removes" ) {
+        for( int i = 20; i > 0; --i ) {
+            tree.insert( i );
+        }
+        for( int i = 1; i <= 20; i += 3 ) {
+            tree.remove( i );
+        }
+        
+        std::vector<int> keys;
+        tree.for_each( [&]( int key ) { keys.push_back( key ); } );
+        REQUIRE( keys.size() == 13 );
+        for( std::size_t n = 1; n <= keys.size(); ++n ) {
+            REQUIRE( *tree.select( n ) == keys[ n - 1 ] );
+        }
+    }
+    SECTION( "by rank" ) {
+        for( int i = 0; i < 50; ++i ) {
+            tree.insert( ( i * 7 ) % 50 * 2 );
+        }
+        tree.insert( 10 );
+        
+        REQUIRE( tree.rank( -1 ) == 0 );
+        REQUIRE( tree.rank( 0 ) == 0 );
+        REQUIRE( tree.rank( 1 ) == 1 );
+        REQUIRE( tree.rank( 10 ) == 5 );
+        REQUIRE( tree.rank( 11 ) == 7 );
+        REQUIRE( tree.rank( 1000 ) == 51 );
+        for( std::size_t n = 1; n <= tree.size(); ++n ) {
+            REQUIRE( *tree.select( tree.rank( *tree.select( n ) ) + 1 ) == *tree.select( n ) );
+        }
+    }
+}
+
+TEST_CASE( "keys can be looked up in groups", "[find_many]" ) {
+    rb_tree_t<int> tree;
+    
+    std::vector<int> keys;
+    std::vector<bool> result;
+    tree.find_many( keys.begin(), keys.end(), std::back_inserter( result ) );
+    REQUIRE( result.empty() );
+    
+    for( int i = 0; i < 100; i += 2 ) {
+        tree.insert( i );
+    }
+    
+    for( int i = -5; i < 105; ++i ) {
+        keys.push_back( i );
+    }
+    tree.find_many( keys.begin(), keys.end(), std::back_inserter( result ) );
+    
+    REQUIRE( result.size() == keys.size() );
+    for( std::size_t i = 0; i < keys.size(); ++i ) {
+        REQUIRE( result[ i ] == ( keys[ i ] >= 0 && keys[ i ] < 100 && keys[ i ] % 2 == 0 ) );
+    }
+    
+    rb_tree_t<std::string> strings;
+    for( auto && key : { "delta", "alpha", "charlie" } ) {
+        strings.insert( key );
+    }
+    std::vector<std::string> string_keys = { "alpha", "bravo", "charlie", "echo", "" };
+    result.clear();
+    strings.find_many( string_keys.begin(), string_keys.end(), std::back_inserter( result ) );
+    REQUIRE( result == std::vector<bool>{ true, false, true, false, false } );
+}
+
+TEST_CASE( "nodes can be compacted", "[compact]" ) {
+    rb_tree_t<int> tree;
+    for( int i = 0; i < 200; ++i ) {
+        tree.insert( ( i * 37 ) % 101 );
+    }
+    for( int i = 0; i < 50; ++i ) {
+        tree.remove( ( i * 13 ) % 101 );
+    }
+    
+    auto representation = tree.representation();
+    
+    SECTION( "at once" ) {
+        tree.compact();
+        REQUIRE( tree.representation() == representation );
+    }
+    
+    SECTION( "incrementally" ) {
+        std::size_t calls = 1;
+        while( !tree.compact( 16 ) ) {
+            REQUIRE( tree.representation() == representation );
+            ++calls;
+        }
+        REQUIRE( calls == ( tree.size() + 15 ) / 16 );
+        REQUIRE( tree.representation() == representation );
+    }
+    
+    SECTION( "interrupted by insert" ) {
+        tree.compact( 10 );
+        tree.insert( 1000 );
+        tree.compact();
+        REQUIRE( tree.representation() == representation + "r1000" );
+    }
+    
+    SECTION( "under churn" ) {
+        std::vector<int> live;
+        tree.for_each( [&]( int key ) { live.push_back( key ); } );
+        
+        std::size_t calls = 1;
+        for( int i = 0; !tree.compact( 8 ); ++i ) {
+            // Removes every key in turn, including the one at the cursor
+            auto & victim = live[ std::size_t( i ) % live.size() ];
+            tree.remove( victim );
+            victim = 200 + i;
+            tree.insert( victim );
+            ++calls;
+        }
+        REQUIRE( calls < live.size() );
+        REQUIRE( tree.size() == live.size() );
+        
+        std::sort( live.begin(), live.end() );
+        std::vector<int> keys;
+        tree.for_each( [&]( int key ) { keys.push_back( key ); } );
+        REQUIRE( keys == live );
+    }
+
+    std::vector<int> keys;
+    tree.for_each( [&]( int key ) { keys.push_back( key ); } );
+    REQUIRE( keys.size() == tree.size() );
+    REQUIRE( std::is_sorted( keys.begin(), keys.end() ) );
+}
+
+TEST_CASE( "trees can be copied", "[copy]" ) {
+    rb_tree_t<int> tree;
+    for( int i = 0; i < 100; ++i ) {
+        tree.insert( ( i * 7 ) % 31 );
+    }
+    auto representation = tree.representation();
+    
+    SECTION( "by constructor" ) {
+        rb_tree_t<int> copy{ tree };
+        REQUIRE( copy.representation() == representation );
+        REQUIRE( copy.size() == tree.size() );
+        
+        copy.remove( 3 );
+        copy.insert( 100 );
+        REQUIRE( tree.representation() == representation );
+        REQUIRE( *copy.select( copy.size() ) == 100 );
+    }
+    
+    SECTION( "by assignment" ) {
+        rb_tree_t<int> copy;
+        copy.insert( 1 );
+        copy = tree;
+        REQUIRE( copy.representation() == representation );
+        
+        tree.remove( 5 );
+        REQUIRE( copy.representation() == representation );
+        
+        rb_tree_t<int> moved;
+        moved = std::move( copy );
+        REQUIRE( moved.representation() == representation );
+        REQUIRE( copy.size() == 0 );
+    }
+    
+    SECTION( "by clone" ) {
+        rb_tree_t<int> expected{ tree };
+        expected.insert( 200 );
+        
+        auto clone = tree.clone();
+        REQUIRE( clone.representation() == representation );
+        
+        clone.insert( 200 );
+        tree.remove( 4 );
+        REQUIRE( clone.representation() == expected.representation() );
+        REQUIRE( tree.size() == 99 );
+        REQUIRE( clone.size() == 101 );
+        
+        auto other = clone.clone();
+        clone.clear();
+        REQUIRE( clone.size() == 0 );
+        REQUIRE( other.size() == 101 );
+        REQUIRE( other.representation() == expected.representation() );
+    }
+    
+    SECTION( "by clone of an empty tree" ) {
+        rb_tree_t<int> empty;
+        auto clone = empty.clone();
+        auto other = empty.clone();
+        
+        clone.insert( 1 );
+        empty.insert( 2 );
+        empty.remove( 2 );
+        REQUIRE( empty.compact( 16 ) );
+        other.remove( 3 );
+        other.compact();
+        
+        REQUIRE( clone.representation() == "b1" );
+        REQUIRE( empty.size() == 0 );
+        REQUIRE( other.size() == 0 );
+    }
+}
+
+TEST_CASE( "keys can be ordered by comparator", "[compare]" ) {
+    SECTION( "arithmetic keys in descending order" ) {
+        rb_tree_t<double, std::greater<double>> tree;
+        for( int i = 0; i < 20; ++i ) {
+            tree.insert( i * 0.5 );
+        }
+        tree.remove( 3.0 );
+        tree.remove( 3.25 );
+        
+        REQUIRE( tree.size() == 19 );
+        REQUIRE( *tree.select( 1 ) == 9.5 );
+        REQUIRE( *tree.select( 19 ) == 0.0 );
+        
+        std::vector<double> keys = { 3.0, 3.5, 9.5, 10.0 };
+        std::vector<bool> result;
+        tree.find_many( keys.begin(), keys.end(), std::back_inserter( result ) );
+        REQUIRE( result == std::vector<bool>{ false, true, true, false } );
+    }
+    
+    SECTION( "other keys" ) {
+        struct by_length
+        {
+            bool operator ()( std::string const & lhs, std::string const & rhs ) const
+            {
+                return lhs.size() < rhs.size();
+            }
+        };
+        
+        rb_tree_t<std::string, by_length> tree{ by_length{} };
+        tree.insert( "ccc" );
+        tree.insert( "a" );
+        tree.insert( "bb" );
+        tree.remove( "xx" );
+        
+        REQUIRE( tree.size() == 2 );
+        REQUIRE( tree.representation() == "rabccc" );
+    }
+}
+
+TEST_CASE( "elements can be inserted and removed top-down", "[top_down]" ) {
+    rb_tree_t<int> tree;
+    rb_tree_t<int> expected;
+    for( int i = 0; i < 300; ++i ) {
+        tree.insert_top_down( ( i * 53 ) % 97 );
+        expected.insert( ( i * 53 ) % 97 );
+    }
+    REQUIRE( tree.size() == expected.size() );
+    
+    for( int i = 0; i < 150; ++i ) {
+        tree.remove_top_down( ( i * 29 ) % 113 );
+        expected.remove( ( i * 29 ) % 113 );
+    }
+    REQUIRE( tree.size() == expected.size() );
+    
+    std::vector<int> keys;
+    std::vector<int> expected_keys;
+    tree.for_each( [&]( int key ) { keys.push_back( key ); } );
+    expected.for_each( [&]( int key ) { expected_keys.push_back( key ); } );
+    REQUIRE( keys == expected_keys );
+    
+    for( std::size_t n = 1; n <= keys.size(); ++n ) {
+        REQUIRE( *tree.select( n ) == keys[ n - 1 ] );
+    }
+    
+    for( auto key : expected_keys ) {
+        tree.remove_top_down( key );
+    }
+    REQUIRE( tree.size() == 0 );
+    REQUIRE( tree.representation() == "" );
+}
+
+// Disabled statistics and a stateless comparator take no space in the tree,
+// policies with state add exactly their own size
+using rb_tree_with_state_t = rb_tree_t<int, bool ( * )( int, int ), rb_tree_statistics_t>;
+static_assert( sizeof( rb_tree_with_state_t ) == sizeof( rb_tree_t<int> ) + sizeof( bool ( * )( int, int ) ) + sizeof( rb_tree_statistics_t ),
+               "empty policies must not grow the tree" );
+
+TEST_CASE( "work and shape of rb tree can be measured", "[statistics]" ) {
+    rb_tree_t<int, std::less<int>, rb_tree_statistics_t> tree;
+    
+    auto empty = tree.stats();
+    REQUIRE( empty.size == 0 );
+    REQUIRE( empty.height == 0 );
+    REQUIRE( empty.black_height == 0 );
+    REQUIRE( empty.depth_histogram.empty() );
+    
+    for( int i = 1; i <= 7; ++i ) {
+        tree.insert( i );
+    }
+    
+    // b2( b1, r4( b3, b6( r5, r7 ) ) )
+    auto stats = tree.stats();
+    REQUIRE( stats.size == 7 );
+    REQUIRE( stats.height == 4 );
+    REQUIRE( stats.black_height == 2 );
+    REQUIRE( stats.depth_histogram == std::vector<std::size_t>{ 1, 2, 2, 2 } );
+    
+    auto && counters = tree.statistics();
+    REQUIRE( counters.left_rotations == 3 );
+    REQUIRE( counters.right_rotations == 0 );
+    REQUIRE( counters.allocations == 7 );
+    REQUIRE( counters.descents == 7 );
+    REQUIRE( counters.comparisons == 0 + 1 + 2 + 2 + 3 + 3 + 4 );
+    
+    auto comparisons = counters.comparisons;
+    REQUIRE( tree.contains( 5 ) );
+    REQUIRE( counters.descents == 8 );
+    REQUIRE( counters.comparisons > comparisons );
+    
+    tree.remove( 1 );
+    REQUIRE( counters.remove_fix_up_iterations > 0 );
+    REQUIRE( counters.recount_walks > 0 );
+    REQUIRE( sizeof( rb_tree_t<int> ) < sizeof( tree ) );
+}
+
+TEST_CASE( "trees can be drawn", "[print]" ) {
+    rb_tree_t<int> tree;
+    for( int i = 1; i <= 5; ++i ) {
+        tree.insert( i );
+    }
+    
+    std::ostringstream full;
+    tree.print( full );
+    REQUIRE( full.str() ==
+        "     5b2\n"
+        "    /   \\\n"
+        "   /     \\\n"
+        "1b1       3b4\n"
+        "         /   \\\n"
+        "        /     \\\n"
+        "     1r3       1r5\n"
+        "\n" );
+    
+    std::ostringstream limited;
+    tree.print( limited, 2, 6 );
+    REQUIRE( limited.str() ==
+        "     5\n"
+        "    / \n"
+        "   /  \n"
+        "1b1   \n"
+        "\n" );
+    
+    std::ostringstream dot;
+    tree.dot( dot, 2 );
+    REQUIRE( dot.str() ==
+        "digraph rb_tree {\n"
+        "    node [shape=circle, style=filled, fontcolor=white];\n"
+        "    n0 [label=\"2\", xlabel=\"5\", fillcolor=black];\n"
+        "    n0 -> n1;\n"
+        "    n0 -> n2;\n"
+        "    n1 [label=\"1\", xlabel=\"1\", fillcolor=black];\n"
+        "    n2 [label=\"4\", xlabel=\"3\", fillcolor=black];\n"
+        "}\n" );
+}
+
+TEST_CASE( "keys can be replaced", "[replace]" ) {
+    rb_tree_t<int> tree;
+    for( int i = 0; i < 20; ++i ) {
+        tree.insert( i * 10 );
+    }
+    
+    std::vector<int> keys;
+    auto check = [&] {
+        std::sort( keys.begin(), keys.end() );
+        REQUIRE( tree.size() == keys.size() );
+        auto stats = tree.stats();
+        REQUIRE( stats.height <= 2 * stats.black_height );
+        int key = -1;
+        for( std::size_t n = 1; n <= keys.size(); ++n ) {
+            REQUIRE( tree.select( n, key ) );
+            REQUIRE( key == keys[ n - 1 ] );
+        }
+        REQUIRE_FALSE( tree.select( 0, key ) );
+        REQUIRE_FALSE( tree.select( keys.size() + 1, key ) );
+    };
+    for( int i = 0; i < 20; ++i ) {
+        keys.push_back( i * 10 );
+    }
+    
+    SECTION( "in place" ) {
+        tree.replace( 50, 55 );
+        keys[ 5 ] = 55;
+        check();
+        REQUIRE( tree.contains( 55 ) );
+        REQUIRE_FALSE( tree.contains( 50 ) );
+    }
+    SECTION( "by relinking" ) {
+        for( int i = 0; i < 20; i += 2 ) {
+            tree.replace( i * 10, 1000 - i );
+            keys[ i ] = 1000 - i;
+        }
+        tree.replace( 10, 10 );
+        check();
+    }
+    SECTION( "when missing" ) {
+        tree.replace( 5, 7 );
+        keys.push_back( 7 );
+        check();
+    }
+}
+
+TEST_CASE( "keys can be removed lazily", "[lazy_remove]" ) {
+    rb_tree_t<int> tree;
+    std::vector<int> keys;
+    for( int i = 0; i < 200; ++i ) {
+        tree.insert( ( i * 37 ) % 100 );
+        keys.push_back( ( i * 37 ) % 100 );
+    }
+    
+    auto erase = [&]( int key ) {
+        auto found = std::find( keys.begin(), keys.end(), key );
+        if( found != keys.end() ) {
+            keys.erase( found );
+        }
+        tree.remove( key );
+    };
+    auto check = [&] {
+        std::sort( keys.begin(), keys.end() );
+        REQUIRE( tree.size() == keys.size() );
+        
+        std::vector<int> walked;
+        tree.for_each( [&]( int key ) { walked.push_back( key ); } );
+        REQUIRE( walked == keys );
+        
+        for( std::size_t n = 1; n <= keys.size(); ++n ) {
+            REQUIRE( *tree.select( n ) == keys[ n - 1 ] );
+        }
+        REQUIRE( tree.select( keys.size() + 1 ) == nullptr );
+        
+        std::vector<int> probes;
+        std::vector<bool> found;
+        for( int key = -1; key <= 100; ++key ) {
+            auto expected = std::lower_bound( keys.begin(), keys.end(), key ) - keys.begin();
+            REQUIRE( tree.rank( key ) == std::size_t( expected ) );
+            REQUIRE( tree.contains( key ) == std::binary_search( keys.begin(), keys.end(), key ) );
+            probes.push_back( key );
+        }
+        tree.find_many( probes.begin(), probes.end(), std::back_inserter( found ) );
+        for( std::size_t i = 0; i < probes.size(); ++i ) {
+            REQUIRE( found[ i ] == std::binary_search( keys.begin(), keys.end(), probes[ i ] ) );
+        }
+    };
+    
+    SECTION( "leaving tombstones" ) {
+        tree.lazy_remove( 0.9 );
+        auto height = tree.stats().height;
+        for( int key = 0; key < 100; key += 3 ) {
+            erase( key );
+        }
+        erase( 1000 );
+        REQUIRE( tree.tombstones() == 34 );
+        REQUIRE( tree.stats().height == height );
+        check();
+        
+        // Duplicates of a tombstone stay visible
+        erase( 1 );
+        REQUIRE( tree.contains( 1 ) );
+        erase( 1 );
+        REQUIRE_FALSE( tree.contains( 1 ) );
+        tree.remove_top_down( 2 );
+        keys.erase( std::find( keys.begin(), keys.end(), 2 ) );
+        check();
+        
+        tree.insert( 3 );
+        keys.push_back( 3 );
+        tree.replace( 4, 0 );
+        *std::find( keys.begin(), keys.end(), 4 ) = 0;
+        check();
+    }
+    SECTION( "purged incrementally" ) {
+        tree.lazy_remove( 0.9 );
+        for( int key = 0; key < 100; key += 2 ) {
+            erase( key );
+        }
+        
+        std::size_t calls = 1;
+        for( ; !tree.purge( 16 ); ++calls ) {
+            check();
+        }
+        REQUIRE( calls > 1 );
+        REQUIRE( tree.tombstones() == 0 );
+        check();
+    }
+    SECTION( "purged inline with a budget" ) {
+        tree.lazy_remove( 0.2, 8 );
+        for( int key = 0; key < 100; ++key ) {
+            erase( key );
+            REQUIRE( tree.tombstones() <= 70 );
+        }
+        check();
+        
+        tree.eager_remove();
+        REQUIRE( tree.tombstones() == 0 );
+        check();
+    }
+    SECTION( "purged inline by rebuild" ) {
+        tree.lazy_remove( 0.2 );
+        for( int key = 0; key < 100; key += 2 ) {
+            erase( key );
+            REQUIRE( double( tree.tombstones() ) <= 0.2 * double( tree.size() + tree.tombstones() ) );
+        }
+        check();
+        
+        auto stats = tree.stats();
+        REQUIRE( stats.height <= 2 * stats.black_height );
+    }
+    SECTION( "when copied, compacted and saved" ) {
+        tree.lazy_remove( 0.9 );
+        for( int key = 0; key < 100; key += 5 ) {
+            erase( key );
+        }
+        
+        auto clone = tree.clone();
+        clone.remove( 1 );
+        REQUIRE( clone.size() + 1 == tree.size() );
+        
+        rb_tree_t<int> copy{ tree };
+        REQUIRE( copy.tombstones() == tree.tombstones() );
+        
+        tree.compact();
+        check();
+        
+        std::string const path = "rb_tree_lazy.tmp";
+        REQUIRE( tree.save( path ) );
+        rb_tree_t<int> loaded;
+        REQUIRE( loaded.load( path ) );
+        std::remove( path.c_str() );
+        REQUIRE( loaded.size() == keys.size() );
+        REQUIRE( loaded.tombstones() == 0 );
+        
+        tree.purge();
+        REQUIRE( tree.tombstones() == 0 );
+        check();
+    }
+}
+
+TEST_CASE( "memory of rb tree can be measured", "[memory]" ) {
+    rb_tree_t<int> tree;
+    REQUIRE( tree.memory_usage().total() == 0 );
+    
+    for( int i = 0; i < 100; ++i ) {
+        tree.insert( i );
+    }
+    auto hundred = tree.memory_usage();
+    REQUIRE( hundred.nodes >= 100 * sizeof( int ) );
+    REQUIRE( hundred.overhead > 0 );
+    REQUIRE( hundred.keys == 0 );
+    
+    for( int i = 100; i < 200; ++i ) {
+        tree.insert( i );
+    }
+    REQUIRE( tree.memory_usage().nodes == 2 * hundred.nodes );
+    REQUIRE( tree.memory_usage().overhead == 2 * hundred.overhead );
+    
+    SECTION( "after removes" ) {
+        for( int i = 100; i < 200; ++i ) {
+            tree.remove( i );
+        }
+        REQUIRE( tree.memory_usage().total() == hundred.total() );
+        
+        tree.clear();
+        REQUIRE( tree.memory_usage().total() == 0 );
+    }
+    SECTION( "in blocks" ) {
+        auto loose = tree.memory_usage();
+        tree.compact();
+        auto compacted = tree.memory_usage();
+        REQUIRE( compacted.nodes == loose.nodes );
+        REQUIRE( compacted.overhead < loose.overhead );
+        
+        // Removed nodes stay in their block
+        tree.remove( 1 );
+        REQUIRE( tree.memory_usage().total() == compacted.total() );
+        
+        auto clone = tree.clone();
+        REQUIRE( clone.memory_usage().total() == compacted.total() );
+        
+        rb_tree_t<int> copy{ tree };
+        REQUIRE( copy.memory_usage().nodes < compacted.nodes );
+    }
+    SECTION( "within a budget" ) {
+        tree.memory_budget( tree.memory_usage().total() + hundred.total() / 2 );
+        int i = 200;
+        for( ; tree.insert( i ); ++i ) {
+        }
+        REQUIRE( i >= 249 );
+        REQUIRE( i <= 251 );
+        REQUIRE( tree.contains( i ) );
+        REQUIRE_FALSE( tree.insert_top_down( ++i ) );
+        
+        tree.memory_budget( std::size_t( -1 ) );
+        REQUIRE( tree.insert( ++i ) );
+    }
+}
+
+TEST_CASE( "memory owned by keys can be measured", "[memory]" ) {
+    rb_tree_t<std::string> tree;
+    std::string const long_key( 1000, 'x' );
+    
+    tree.insert( "short" );
+    REQUIRE( tree.memory_usage().keys == 0 );
+    
+    tree.insert( long_key );
+    REQUIRE( tree.memory_usage().keys > 1000 );
+    REQUIRE( tree.memory_usage().keys < 2000 );
+    
+    auto one = tree.memory_usage().keys;
+    tree.replace( "short", long_key + "y" );
+    REQUIRE( tree.memory_usage().keys > one + 1000 );
+    
+    tree.insert_top_down( "z" );
+    tree.remove_top_down( long_key + "y" );
+    REQUIRE( tree.memory_usage().keys > 1000 );
+    REQUIRE( tree.memory_usage().keys < 2000 );
+    
+    rb_tree_t<std::string> copy{ tree };
+    tree.remove( long_key );
+    REQUIRE( tree.memory_usage().keys == 0 );
+    REQUIRE( copy.memory_usage().keys > 1000 );
+    
+    SECTION( "after nodes are copied" ) {
+        auto walked = []( rb_tree_t<std::string> const & tree ) {
+            std::size_t result = 0;
+            tree.for_each( [&result]( std::string const & key ) {
+                result += rb_tree_key_memory<std::string>::heap_bytes( key );
+            } );
+            return result;
+        };
+        
+        // Copies of keys with spare capacity hold less memory than the keys
+        for( int i = 0; i < 100; ++i ) {
+            std::string key( 100, char( 'a' + i % 26 ) );
+            key += std::to_string( i );
+            key.reserve( 200 + i * 10 );
+            tree.insert( std::move( key ) );
+        }
+        REQUIRE( tree.memory_usage().keys == walked( tree ) );
+        
+        tree.compact();
+        REQUIRE( tree.memory_usage().keys == walked( tree ) );
+        
+        auto clone = tree.clone();
+        clone.insert( "a" );
+        REQUIRE( clone.memory_usage().keys == walked( clone ) );
+        REQUIRE( clone.memory_usage().keys < tree.memory_usage().keys );
+        tree.insert( "b" );
+        REQUIRE( tree.memory_usage().keys == walked( tree ) );
+        
+        rb_tree_t<std::string> other{ tree };
+        REQUIRE( other.memory_usage().keys == walked( other ) );
+    }
 }
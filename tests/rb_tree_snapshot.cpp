@@ -0,0 +1,208 @@
+#include <catch.hpp>
+#include <cstddef>
+#include <cstdint>
+#include <cstdio>
+#include <fstream>
+#include <functional>
+#include <iterator>
+#include <string>
+#include <vector>
+#include "rb_tree.hpp"
+#include "rb_tree_snapshot.hpp"
+
+TEST_CASE( "trees can be saved and loaded", "[snapshot]" ) {
+    std::string const path = "rb_tree_snapshot.tmp";
+
+    rb_tree_t<int> tree;
+    for( int i = 0; i < 100; ++i ) {
+        tree.insert( ( i * 37 ) % 101 );
+    }
+    tree.remove( 37 );
+
+    std::vector<int> keys;
+    tree.for_each( [&]( int key ) { keys.push_back( key ); } );
+
+    SECTION( "with shape" ) {
+        REQUIRE( tree.save( path ) );
+
+        rb_tree_t<int> loaded;
+        loaded.insert( 1000 );
+        REQUIRE( loaded.load( path ) );
+        REQUIRE( loaded.representation() == tree.representation() );
+        REQUIRE( loaded.size() == tree.size() );
+
+        for( std::size_t n = 1; n <= keys.size(); ++n ) {
+            REQUIRE( *loaded.select( n ) == keys[ n - 1 ] );
+        }
+
+        loaded.insert( 37 );
+        loaded.remove( 0 );
+        REQUIRE( loaded.size() == tree.size() );
+        REQUIRE( *loaded.select( 37 ) == 37 );
+    }
+
+    SECTION( "without shape" ) {
+        REQUIRE( tree.save( path, false ) );
+
+        rb_tree_t<int> loaded;
+        REQUIRE( loaded.load( path ) );
+        REQUIRE( loaded.size() == keys.size() );
+        REQUIRE( loaded.stats().height == 7 );
+
+        std::vector<int> loaded_keys;
+        loaded.for_each( [&]( int key ) { loaded_keys.push_back( key ); } );
+        REQUIRE( loaded_keys == keys );
+
+        for( std::size_t n = 1; n <= keys.size(); ++n ) {
+            REQUIRE( *loaded.select( n ) == keys[ n - 1 ] );
+        }
+
+        for( auto key : keys ) {
+            loaded.remove( key );
+        }
+        REQUIRE( loaded.size() == 0 );
+    }
+
+    SECTION( "with other keys" ) {
+        rb_tree_t<std::string> strings;
+        for( auto && key : { "delta", "alpha", "", "charlie", "bravo" } ) {
+            strings.insert( key );
+        }
+        REQUIRE( strings.save( path ) );
+
+        rb_tree_t<std::string> loaded;
+        REQUIRE( loaded.load( path ) );
+        REQUIRE( loaded.representation() == strings.representation() );
+
+        rb_tree_t<int> other;
+        REQUIRE( !other.load( path ) );
+    }
+
+    SECTION( "as mapped view" ) {
+        REQUIRE( tree.save( path ) );
+
+        rb_tree_snapshot_t<int> snapshot;
+        REQUIRE( snapshot.open( path ) );
+        REQUIRE( snapshot.size() == keys.size() );
+        REQUIRE( std::vector<int>( snapshot.begin(), snapshot.end() ) == keys );
+        REQUIRE( snapshot.contains( 36 ) );
+        REQUIRE( !snapshot.contains( 37 ) );
+        REQUIRE( !snapshot.contains( 101 ) );
+        REQUIRE( *snapshot.select( 1 ) == 0 );
+        REQUIRE( snapshot.select( 0 ) == nullptr );
+        REQUIRE( snapshot.select( keys.size() + 1 ) == nullptr );
+        REQUIRE( snapshot.rank( 37 ) == 37 );
+
+        auto moved = std::move( snapshot );
+        REQUIRE( snapshot.size() == 0 );
+        REQUIRE( moved.contains( 99 ) );
+
+        rb_tree_snapshot_t<double> other;
+        REQUIRE( !other.open( path ) );
+    }
+
+    SECTION( "only with the order they were saved in" ) {
+        rb_tree_t<int, std::greater<int>> descending;
+        for( auto key : keys ) {
+            descending.insert( key );
+        }
+        REQUIRE( descending.save( path ) );
+        
+        rb_tree_t<int> ascending;
+        REQUIRE( !ascending.load( path ) );
+        rb_tree_snapshot_t<int> snapshot;
+        REQUIRE( !snapshot.open( path ) );
+        
+        rb_tree_t<int, std::greater<int>> loaded;
+        REQUIRE( loaded.load( path ) );
+        REQUIRE( loaded.representation() == descending.representation() );
+        rb_tree_snapshot_t<int, std::greater<int>> descending_snapshot;
+        REQUIRE( descending_snapshot.open( path ) );
+        REQUIRE( descending_snapshot.contains( 36 ) );
+        REQUIRE( !descending_snapshot.contains( 37 ) );
+        REQUIRE( *descending_snapshot.select( 1 ) == 100 );
+        REQUIRE( descending_snapshot.rank( 90 ) == 10 );
+    }
+    
+    SECTION( "unless corrupted" ) {
+        REQUIRE( tree.save( path ) );
+
+        std::fstream file{ path, std::ios::binary | std::ios::in | std::ios::out };
+        file.seekp( -1, std::ios::end );
+        file.put( 'x' );
+        file.close();
+
+        rb_tree_t<int> loaded;
+        loaded.insert( 5 );
+        REQUIRE( !loaded.load( path ) );
+        REQUIRE( loaded.representation() == "b5" );
+
+        rb_tree_snapshot_t<int> snapshot;
+        REQUIRE( !snapshot.open( path ) );
+        REQUIRE( snapshot.open( path, false ) );
+
+        std::ofstream{ path, std::ios::binary | std::ios::trunc } << "rb_tree";
+        REQUIRE( !loaded.load( path ) );
+        REQUIRE( !loaded.load( "missing.tmp" ) );
+    }
+
+    SECTION( "unless truncated" ) {
+        for( auto shape : { true, false } ) {
+            REQUIRE( tree.save( path, shape ) );
+
+            std::ifstream input{ path, std::ios::binary };
+            std::string image{ std::istreambuf_iterator<char>{ input }, std::istreambuf_iterator<char>{} };
+            input.close();
+            std::ofstream{ path, std::ios::binary | std::ios::trunc }.write( image.data(), std::streamsize( image.size() - 5 ) );
+
+            rb_tree_t<int> loaded;
+            loaded.insert( 5 );
+            REQUIRE( !loaded.load( path ) );
+            REQUIRE( loaded.representation() == "b5" );
+        }
+    }
+
+    SECTION( "unless sizes are out of range" ) {
+        auto header = [&] {
+            rb_tree_file_header_t result;
+            std::ifstream{ path, std::ios::binary }.read( reinterpret_cast<char *>( &result ), sizeof( result ) );
+            return result;
+        };
+        auto patch = [&]( std::uint64_t offset, std::uint64_t value ) {
+            std::fstream file{ path, std::ios::binary | std::ios::in | std::ios::out };
+            file.seekp( std::streamoff( offset ) );
+            file.write( reinterpret_cast<char const *>( &value ), sizeof( value ) );
+        };
+
+        for( auto size : { std::uint64_t( 1 ) << 40, std::uint64_t( -1 ) } ) {
+            REQUIRE( tree.save( path ) );
+            patch( offsetof( rb_tree_file_header_t, size ), size );
+            rb_tree_t<int> loaded;
+            REQUIRE( !loaded.load( path ) );
+            REQUIRE( loaded.size() == 0 );
+        }
+
+        // Shape of a list, every node has only a left child, with a matching checksum
+        REQUIRE( tree.save( path ) );
+        rb_tree_checksum_t checksum;
+        for( std::uint64_t i = 0; i < tree.size(); ++i ) {
+            std::uint64_t record = ( tree.size() - i - 1 ) << 1;
+            checksum.update( &record, sizeof( record ) );
+            patch( header().shape_offset + i * sizeof( record ), record );
+        }
+        patch( offsetof( rb_tree_file_header_t, shape_checksum ), checksum.value() );
+        rb_tree_t<int> loaded;
+        REQUIRE( !loaded.load( path ) );
+
+        rb_tree_t<std::string> strings;
+        strings.insert( "key" );
+        for( auto length : { std::uint64_t( 1 ) << 40, std::uint64_t( -1 ) } ) {
+            REQUIRE( strings.save( path ) );
+            patch( header().keys_offset, length );
+            rb_tree_t<std::string> loaded_strings;
+            REQUIRE( !loaded_strings.load( path ) );
+        }
+    }
+
+    std::remove( path.c_str() );
+}
@@ -0,0 +1,184 @@
+#include <catch.hpp>
+#include <algorithm>
+#include <cstdint>
+#include <cstdio>
+#include <fstream>
+#include <random>
+#include <string>
+#include <vector>
+#include "rb_tree_trace.hpp"
+
+namespace
+{
+    template< typename T >
+    auto keys( rb_tree_t<T> const & tree ) -> std::vector<T>
+    {
+        std::vector<T> result;
+        tree.for_each( [&result]( T const & key ) {
+            result.push_back( key );
+        } );
+        return result;
+    }
+
+    template< typename T >
+    struct top_down_target_t : rb_tree_trace_target_t<T>
+    {
+        void insert( T const & key )
+        {
+            this->tree.insert_top_down( key );
+        }
+
+        void remove( T const & key )
+        {
+            this->tree.remove_top_down( key );
+        }
+    };
+}
+
+TEST_CASE( "operations can be recorded and replayed", "[trace]" ) {
+    std::string const path = "rb_tree_trace.tmp";
+    std::mt19937 random{ 11 };
+
+    SECTION( "with integer keys" ) {
+        rb_tree_t<int> tree;
+        rb_tree_trace_writer_t<int> writer;
+        REQUIRE( writer.open( path ) );
+
+        rb_tree_trace_recorder_t<int> recorder{ tree, writer };
+        std::vector<rb_tree_trace_record_t<int>> expected;
+        for( int i = 0; i < 5000; ++i ) {
+            auto key = int( random() % 500 );
+            switch( random() % 5 ) {
+            case 0:
+                recorder.insert( key );
+                expected.push_back( { '+', key, 0 } );
+                break;
+            case 1:
+                recorder.remove( key );
+                expected.push_back( { '-', key, 0 } );
+                break;
+            case 2:
+                recorder.contains( key );
+                expected.push_back( { '?', key, 0 } );
+                break;
+            case 3:
+                recorder.select( std::size_t( key ) );
+                expected.push_back( { '#', 0, std::uint64_t( key ) } );
+                break;
+            default:
+                recorder.rank( key );
+                expected.push_back( { 'r', key, 0 } );
+                break;
+            }
+        }
+        REQUIRE( writer.count() == expected.size() );
+        REQUIRE( writer.close() );
+
+        std::vector<rb_tree_trace_record_t<int>> records;
+        REQUIRE( rb_tree_trace_load( path, records ) );
+        REQUIRE( records.size() == expected.size() );
+        for( std::size_t i = 0; i < records.size(); ++i ) {
+            REQUIRE( records[ i ].op == expected[ i ].op );
+            REQUIRE( records[ i ].key == expected[ i ].key );
+            REQUIRE( records[ i ].n == expected[ i ].n );
+        }
+
+        rb_tree_trace_target_t<int> target;
+        auto result = rb_tree_trace_replay( records, target, 64 );
+        REQUIRE( result.latency.count() == records.size() );
+        REQUIRE( result.peak_bytes > 0 );
+        REQUIRE( keys( target.tree ) == keys( tree ) );
+
+        std::uint64_t counted = 0;
+        for( auto && latency : result.op_latency ) {
+            counted += latency.count();
+        }
+        REQUIRE( counted == records.size() );
+
+        // Every way of changing the tree gives the same answers
+        rb_tree_trace_target_t<int> again;
+        REQUIRE( rb_tree_trace_replay( records, again ).checksum == result.checksum );
+
+        top_down_target_t<int> top_down;
+        REQUIRE( rb_tree_trace_replay( records, top_down ).checksum == result.checksum );
+
+        rb_tree_trace_target_t<int> lazy;
+        lazy.tree.lazy_remove( 0.25, 8 );
+        REQUIRE( rb_tree_trace_replay( records, lazy ).checksum == result.checksum );
+
+        // Dropping a query changes the answers
+        records.erase( std::find_if( records.begin(), records.end(), []( rb_tree_trace_record_t<int> const & record ) {
+            return record.op == '?';
+        } ) );
+        rb_tree_trace_target_t<int> shorter;
+        REQUIRE( rb_tree_trace_replay( records, shorter ).checksum != result.checksum );
+    }
+
+    SECTION( "with string keys" ) {
+        rb_tree_t<std::string> tree;
+        rb_tree_trace_writer_t<std::string> writer;
+        REQUIRE( writer.open( path ) );
+
+        rb_tree_trace_recorder_t<std::string> recorder{ tree, writer };
+        for( int i = 0; i < 1000; ++i ) {
+            auto key = std::string( random() % 40, char( 'a' + random() % 26 ) );
+            if( random() % 3 ) {
+                recorder.insert( key );
+            }
+            else {
+                recorder.remove( key );
+            }
+        }
+        REQUIRE( writer.close() );
+
+        std::vector<rb_tree_trace_record_t<std::string>> records;
+        REQUIRE( rb_tree_trace_load( path, records ) );
+        REQUIRE( records.size() == 1000 );
+
+        rb_tree_trace_target_t<std::string> target;
+        rb_tree_trace_replay( records, target );
+        REQUIRE( keys( target.tree ) == keys( tree ) );
+
+        std::vector<rb_tree_trace_record_t<int>> other;
+        REQUIRE_FALSE( rb_tree_trace_load( path, other ) );
+    }
+
+    SECTION( "corrupted traces are rejected" ) {
+        rb_tree_t<int> tree;
+        rb_tree_trace_writer_t<int> writer;
+        REQUIRE( writer.open( path ) );
+
+        rb_tree_trace_recorder_t<int> recorder{ tree, writer };
+        for( int i = 0; i < 100; ++i ) {
+            recorder.insert( i );
+        }
+        REQUIRE( writer.close() );
+
+        std::vector<rb_tree_trace_record_t<int>> records;
+        REQUIRE( rb_tree_trace_load( path, records ) );
+
+        {
+            std::ofstream stream{ path, std::ios::binary | std::ios::app };
+            stream.put( '?' );
+        }
+        REQUIRE_FALSE( rb_tree_trace_load( path, records ) );
+        REQUIRE( records.size() == 100 );
+
+        {
+            std::fstream stream{ path, std::ios::binary | std::ios::in | std::ios::out };
+            stream.seekp( sizeof( rb_tree_trace_header_t ) + 1 );
+            stream.put( 0x7f );
+        }
+        REQUIRE_FALSE( rb_tree_trace_load( path, records ) );
+        REQUIRE( records.size() == 100 );
+
+        {
+            std::ofstream stream{ path, std::ios::binary | std::ios::trunc };
+            stream << "rb_trace";
+        }
+        REQUIRE_FALSE( rb_tree_trace_load( path, records ) );
+        REQUIRE_FALSE( rb_tree_trace_load( "missing.tmp", records ) );
+    }
+
+    std::remove( path.c_str() );
+}
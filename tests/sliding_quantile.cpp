@@ -0,0 +1,85 @@
+#include <catch.hpp>
+#include <algorithm>
+#include <deque>
+#include <functional>
+#include <iterator>
+#include <random>
+#include <stdexcept>
+#include <vector>
+#include "sliding_quantile.hpp"
+
+namespace
+{
+    // Nearest-rank quantile of a copy of the window
+    template< typename T, typename Compare = std::less<T> >
+    T expected( std::deque<T> const & window, double fraction, Compare compare = Compare{} )
+    {
+        std::vector<T> sorted( window.begin(), window.end() );
+        std::sort( sorted.begin(), sorted.end(), compare );
+        
+        auto scaled = fraction * sorted.size();
+        auto rank = std::size_t( scaled );
+        if( rank < scaled ) {
+            ++rank;
+        }
+        rank = std::max<std::size_t>( 1, std::min( rank, sorted.size() ) );
+        return sorted[ rank - 1 ];
+    }
+}
+
+TEST_CASE( "quantiles of a sliding window can be tracked", "[sliding_quantile]" ) {
+    std::mt19937 random{ 7 };
+    
+    REQUIRE_THROWS_AS( sliding_quantile_t<int>{ 0 }, std::invalid_argument );
+    std::vector<double> const fractions = { 0, 0.01, 0.25, 0.5, 0.75, 0.99, 1 };
+    
+    SECTION( "over random samples" ) {
+        sliding_quantile_t<int> quantiles{ 37 };
+        std::deque<int> window;
+        for( int i = 0; i < 2000; ++i ) {
+            auto sample = int( random() % 100 );
+            quantiles.push( sample );
+            window.push_back( sample );
+            if( window.size() > 37 ) {
+                window.pop_front();
+            }
+            
+            REQUIRE( quantiles.size() == window.size() );
+            REQUIRE( quantiles.tree().size() == window.size() );
+            std::vector<int> values;
+            quantiles.quantiles( fractions.begin(), fractions.end(), std::back_inserter( values ) );
+            for( std::size_t f = 0; f < fractions.size(); ++f ) {
+                REQUIRE( values[ f ] == expected( window, fractions[ f ] ) );
+            }
+        }
+    }
+    
+    SECTION( "with a window of one sample" ) {
+        sliding_quantile_t<int> quantiles{ 1 };
+        for( int i = 0; i < 10; ++i ) {
+            quantiles.push( 10 - i );
+            REQUIRE( quantiles.size() == 1 );
+            REQUIRE( quantiles.quantile( 0.5 ) == 10 - i );
+        }
+    }
+    
+    SECTION( "in descending order" ) {
+        sliding_quantile_t<double, std::greater<double>> quantiles{ 16, std::greater<double>{} };
+        std::deque<double> window;
+        for( int i = 0; i < 200; ++i ) {
+            auto sample = double( random() % 1000 ) / 10;
+            quantiles.push( sample );
+            window.push_back( sample );
+            if( window.size() > 16 ) {
+                window.pop_front();
+            }
+            
+            REQUIRE( quantiles.quantile( 0.9 ) == expected( window, 0.9, std::greater<double>{} ) );
+        }
+        
+        quantiles.clear();
+        REQUIRE( quantiles.size() == 0 );
+        quantiles.push( 1.5 );
+        REQUIRE( quantiles.quantile( 0.5 ) == 1.5 );
+    }
+}
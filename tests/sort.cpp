@@ -0,0 +1,106 @@
+#include <catch.hpp>
+#include <algorithm>
+#include <deque>
+#include <functional>
+#include <random>
+#include <string>
+#include <vector>
+#include "intro_sort.hpp"
+
+namespace
+{
+    auto inputs( std::size_t size ) -> std::vector<std::vector<int>>
+    {
+        std::mt19937 random{ unsigned( size ) };
+        std::vector<std::vector<int>> result( 6, std::vector<int>( size ) );
+        for( std::size_t i = 0; i < size; ++i ) {
+            result[ 0 ][ i ] = int( random() );
+            result[ 1 ][ i ] = int( i );
+            result[ 2 ][ i ] = int( size - i );
+            result[ 3 ][ i ] = int( random() % 4 );
+            result[ 4 ][ i ] = 7;
+            // Organ pipe
+            result[ 5 ][ i ] = int( std::min( i, size - i ) );
+        }
+
+        return result;
+    }
+}
+
+TEST_CASE( "ranges can be sorted", "[sort]" ) {
+    for( std::size_t size : { 0, 1, 2, 24, 25, 127, 128, 1000, 50000 } ) {
+        for( auto values : inputs( size ) ) {
+            auto expected = values;
+            std::sort( expected.begin(), expected.end() );
+
+            auto sorted = values;
+            intro_sort( sorted.begin(), sorted.end() );
+            REQUIRE( sorted == expected );
+
+            for( std::size_t k : { std::size_t( 0 ), size / 3, size / 2, size ? size - 1 : 0 } ) {
+                auto selected = values;
+                quick_select( selected.begin(), selected.begin() + k, selected.end() );
+                if( k < size ) {
+                    REQUIRE( selected[ k ] == expected[ k ] );
+                    REQUIRE( std::all_of( selected.begin(), selected.begin() + k, [&]( int value ) { return value <= expected[ k ]; } ) );
+                    REQUIRE( std::all_of( selected.begin() + k, selected.end(), [&]( int value ) { return value >= expected[ k ]; } ) );
+                }
+
+                auto partial = values;
+                partial_intro_sort( partial.begin(), partial.begin() + k, partial.end() );
+                REQUIRE( std::equal( partial.begin(), partial.begin() + k, expected.begin() ) );
+            }
+        }
+    }
+
+    SECTION( "with other types" ) {
+        std::deque<std::string> strings;
+        for( int i = 0; i < 500; ++i ) {
+            strings.push_back( std::to_string( ( i * 7919 ) % 211 ) );
+        }
+        auto expected = strings;
+        std::sort( expected.begin(), expected.end() );
+
+        intro_sort( strings.begin(), strings.end() );
+        REQUIRE( strings == expected );
+
+        std::vector<double> values = { 3.5, -1.0, 2.0, 3.5, 0.0, -7.25 };
+        intro_sort( values.data(), values.data() + values.size() );
+        REQUIRE( values == std::vector<double>{ -7.25, -1.0, 0.0, 2.0, 3.5, 3.5 } );
+    }
+
+    SECTION( "made of runs" ) {
+        std::vector<int> descending;
+        for( int i = 0; i < 1000; ++i ) {
+            descending.push_back( ( 1000 - i ) / 3 );
+        }
+        auto expected = descending;
+        std::sort( expected.begin(), expected.end() );
+
+        REQUIRE( intro_sort_detail::sort_run( descending.begin(), descending.end() ) );
+        REQUIRE( descending == expected );
+
+        // One element out of place stops both runs
+        auto nearly = expected;
+        std::swap( nearly[ 10 ], nearly[ 900 ] );
+        auto unchanged = nearly;
+        REQUIRE_FALSE( intro_sort_detail::sort_run( nearly.begin(), nearly.end() ) );
+        REQUIRE( nearly == unchanged );
+        intro_sort( nearly.begin(), nearly.end() );
+        REQUIRE( nearly == expected );
+
+        std::reverse( unchanged.begin(), unchanged.end() );
+        REQUIRE_FALSE( intro_sort_detail::sort_run( unchanged.begin(), unchanged.end() ) );
+        intro_sort( unchanged.begin(), unchanged.end() );
+        REQUIRE( unchanged == expected );
+    }
+
+    SECTION( "when partition steps run out" ) {
+        auto values = inputs( 1000 )[ 0 ];
+        auto expected = values;
+        std::sort( expected.begin(), expected.end() );
+
+        intro_sort_detail::sort_loop( values.begin(), values.end(), 1 );
+        REQUIRE( values == expected );
+    }
+}